@@ -0,0 +1,70 @@
+#ifndef BARRIERTAPECONTOURS_H_
+#define BARRIERTAPECONTOURS_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * Detected barrier tape contours stored as flat arrays.
+ *
+ * The points of contour i are points[offsets[i]] ... points[offsets[i + 1] - 1]
+ * and its oriented bounding box is boxes[i]. clear() keeps the capacity of all
+ * arrays, so an instance reused across frames stops allocating once it has
+ * grown to the largest frame.
+ */
+struct BarrierTapeContours
+{
+    std::vector<cv::Point> points;
+    std::vector<int> offsets;
+    std::vector<cv::RotatedRect> boxes;
+
+    BarrierTapeContours()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        points.clear();
+        offsets.clear();
+        offsets.push_back(0);
+        boxes.clear();
+    }
+
+    /**
+     * Number of contours
+     */
+    size_t size() const
+    {
+        return boxes.size();
+    }
+
+    bool empty() const
+    {
+        return boxes.empty();
+    }
+
+    void addContour(const std::vector<cv::Point> &contour, const cv::RotatedRect &box)
+    {
+        points.insert(points.end(), contour.begin(), contour.end());
+        offsets.push_back(static_cast<int>(points.size()));
+        boxes.push_back(box);
+    }
+
+    const cv::Point *contourBegin(size_t i) const
+    {
+        return points.data() + offsets[i];
+    }
+
+    const cv::Point *contourEnd(size_t i) const
+    {
+        return points.data() + offsets[i + 1];
+    }
+
+    int contourSize(size_t i) const
+    {
+        return offsets[i + 1] - offsets[i];
+    }
+};
+
+#endif /* BARRIERTAPECONTOURS_H_ */
@@ -4,24 +4,139 @@
 #include <opencv2/opencv.hpp>
 #include <vector>
 
+#include <mir_barrier_tape_detection/barrier_tape_contours.h>
+#include <mir_barrier_tape_detection/color_threshold_filter.h>
+
+/**
+ * Time in milliseconds spent in each stage during the last call to detectBarrierTape
+ */
+struct BarrierTapeStageTimings
+{
+    double downsampling;
+    double segmentation;
+    double blur;
+    double edge_detection;
+    double contour_detection;
+    double box_fitting;
+
+    BarrierTapeStageTimings()
+        : downsampling(0.0), segmentation(0.0), blur(0.0), edge_detection(0.0), contour_detection(0.0), box_fitting(0.0)
+    {
+    }
+};
+
 class BarrierTapeDetection
 {
 public:
+    enum ExtractionMethod
+    {
+        /**
+         * Blur the colour mask, run Canny on it and find the external contours of the edges
+         */
+        CANNY_CONTOURS = 0,
+        /**
+         * Label connected components of the colour mask, fit oriented boxes from their
+         * second order moments and trace the boundary only of components above min_area
+         */
+        CONNECTED_COMPONENTS = 1
+    };
+
     BarrierTapeDetection();
     virtual ~BarrierTapeDetection();
     /**
-     * Convert to HSV, filter based on color_thresh_min and color_thresh_max, blur
+     * Filter based on color_thresh_min and color_thresh_max in a single fused pass
+     * (no intermediate HSV image), then blur the mask with a separable gaussian
      */
     void preprocessImage(const cv::Mat &input_img, cv::Mat &output_img);
     /**
      * Canny edge detection, contour detection, filter contours within certain area range
+     *
+     * barrier_tape_contours is cleared and filled with the accepted contours and their
+     * oriented boxes. Reusing the same instance across frames avoids reallocating it.
+     *
+     * In tracking mode only regions around the previous detections are searched, and the
+     * full image only every full_search_interval frames or when the tape is lost
+     */
+    bool detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, BarrierTapeContours &barrier_tape_contours);
+    /**
+     * Same as above, but appends for each contour a list of pixels whose first
+     * element is the box center, followed by the contour points
      */
     bool detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, std::vector< std::vector<std::vector<int> > > &barrier_tape_pts);
+    /**
+     * Detect all colour classes. Every pixel is labelled with its class in a single pass,
+     * then contours are extracted separately per class. class_contours is resized to the
+     * number of classes and class_contours[0] holds the contours of the class set by
+     * updateDynamicVariables
+     */
+    bool detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, std::vector<BarrierTapeContours> &class_contours);
     /**
      * Set thresholds for min and max HSV values and min area of contours
      */
     void updateDynamicVariables(bool debug_mode, double min_area, int color_thresh_min_h, int color_thresh_min_s,
                                 int color_thresh_min_v, int color_thresh_max_h, int color_thresh_max_s, int color_thresh_max_v);
+    /**
+     * Colour classes detected in addition to the one set by updateDynamicVariables, which
+     * stays class 0. A pixel in several classes belongs to the one with the lowest index
+     */
+    void setAdditionalColorClasses(const std::vector<ColorClass> &color_classes);
+    size_t getNumColorClasses() const;
+    /**
+     * Select how pixels are classified as barrier tape (see ColorThresholdFilter::Method)
+     */
+    void setSegmentationMethod(int segmentation_method);
+    /**
+     * Enable or disable tracking mode. roi_margin is the number of pixels by which the
+     * bounding rectangles of the previous detections are grown to predict the search regions
+     */
+    void setTrackingParameters(bool is_tracking_enabled, int full_search_interval, int roi_margin);
+    /**
+     * Additional margin in pixels to account for the motion of the robot since the last frame
+     */
+    void setRoiMotionMargin(int roi_motion_margin);
+    /**
+     * Segment and find contours on the image downsampled by detection_scale (1, 2 or 4).
+     * Contour points and boxes are still returned in full resolution coordinates, but
+     * contour points are only accurate to detection_scale pixels (see refinePoint)
+     */
+    void setDetectionScale(int detection_scale);
+    /**
+     * Select how contours are extracted from the colour mask (see ExtractionMethod)
+     */
+    void setExtractionMethod(int extraction_method);
+    int getDetectionScale() const;
+    /**
+     * Move a contour point found at a reduced detection scale to the closest full
+     * resolution pixel within detection_scale pixels which belongs to colour class class_id.
+     * Only the pixels around pt are classified. Returns false and leaves pt unchanged if
+     * there is no such pixel
+     */
+    bool refinePoint(const cv::Mat &input_img, cv::Point &pt, size_t class_id = 0) const;
+    const BarrierTapeStageTimings &getStageTimings() const;
+
+private:
+    /**
+     * Detect the first num_classes colour classes, with the tracking logic shared by all classes
+     */
+    bool detectClasses(const cv::Mat &input_img, cv::Mat &output_img, BarrierTapeContours *class_contours,
+                       size_t num_classes);
+    /**
+     * Detect contours inside roi and add them, in full image coordinates, to the contours of their class
+     */
+    void detectInRegion(const cv::Mat &input_img, const cv::Rect &roi, cv::Mat &output_img,
+                        BarrierTapeContours *class_contours, size_t num_classes);
+    /**
+     * Fill search_rois_ with the grown and merged regions of the previous detections
+     */
+    void predictRois(const cv::Rect &full_image);
+    /**
+     * Extraction engines run on the colour mask of the (possibly downsampled) region image.
+     * Results are added in full image coordinates
+     */
+    void extractEdgeContours(const cv::Mat &mask_img, const cv::Rect &roi, cv::Mat &output_img,
+                             BarrierTapeContours &barrier_tape_contours);
+    void extractComponents(const cv::Mat &mask_img, const cv::Rect &roi, cv::Mat &output_img,
+                           BarrierTapeContours &barrier_tape_contours);
 
 private:
     /**
@@ -42,6 +157,54 @@ private:
      * to be part of the barrier tape
      */
     double min_area_;
+
+    /**
+     * Fused BGR to HSV classification against the colour thresholds
+     */
+    ColorThresholdFilter color_filter_;
+    /**
+     * 1D gaussian kernel applied along rows and columns of the mask
+     */
+    cv::Mat blur_kernel_;
+
+    /**
+     * Intermediate images kept across frames so that their buffers are reused
+     */
+    cv::Mat scaled_img_;
+    cv::Mat class_labels_img_;
+    cv::Mat mask_img_;
+    cv::Mat preprocessed_img_;
+    cv::Mat edge_img_;
+    cv::Mat labels_img_;
+    cv::Mat component_stats_;
+    cv::Mat component_centroids_;
+    cv::Mat component_mask_;
+    std::vector<std::vector<cv::Point> > contours_;
+    BarrierTapeContours legacy_contours_;
+
+    /**
+     * Smallest region which is searched in tracking mode
+     */
+    static const int MIN_ROI_SIZE = 8;
+    bool is_tracking_enabled_;
+    int full_search_interval_;
+    int roi_margin_;
+    int roi_motion_margin_;
+    int frames_since_full_search_;
+    /**
+     * Bounding rectangles of the detections in the previous frame
+     */
+    std::vector<cv::Rect> tracked_rois_;
+    std::vector<cv::Rect> search_rois_;
+
+    int detection_scale_;
+    ExtractionMethod extraction_method_;
+    /**
+     * Class 0 is set by updateDynamicVariables, the others by setAdditionalColorClasses
+     */
+    std::vector<ColorClass> color_classes_;
+
+    BarrierTapeStageTimings stage_timings_;
 };
 
 #endif /* BARRIERTAPEDETECTION_H_ */
@@ -0,0 +1,203 @@
+#ifndef COLORTHRESHOLDFILTER_H_
+#define COLORTHRESHOLDFILTER_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * HSV bounds of one tape colour in the opencv (180, 255, 255) range. If the lower
+ * hue is above the upper hue the hue range wraps around 0, e.g. for red
+ */
+struct ColorClass
+{
+    cv::Scalar thresh_min;
+    cv::Scalar thresh_max;
+
+    ColorClass()
+    {
+    }
+
+    ColorClass(const cv::Scalar &color_thresh_min, const cv::Scalar &color_thresh_max)
+        : thresh_min(color_thresh_min), thresh_max(color_thresh_max)
+    {
+    }
+};
+
+class ColorThresholdFilter
+{
+public:
+    enum Method
+    {
+        /**
+         * Compute H, S and V of every pixel and compare against the bounds
+         */
+        FUSED_HSV = 0,
+        /**
+         * Look up the class of every pixel in a quantised 32x32x32 BGR table
+         * which is rebuilt whenever the thresholds change
+         */
+        LOOKUP_TABLE = 1
+    };
+
+    ColorThresholdFilter();
+    virtual ~ColorThresholdFilter();
+    /**
+     * Set the lower and upper HSV bounds of class 0, given in the opencv (180, 255, 255) range
+     */
+    void setThresholds(const cv::Scalar &color_thresh_min, const cv::Scalar &color_thresh_max);
+    /**
+     * Set the bounds of all classes. A pixel belongs to the first class whose bounds it is in
+     */
+    void setClasses(const std::vector<ColorClass> &color_classes);
+    size_t getNumClasses() const;
+    void setMethod(Method method);
+    Method getMethod() const;
+    /**
+     * Classify every pixel of a BGR image against the HSV bounds of class 0 in a single
+     * pass and write 255 (inside) or 0 (outside) into mask. No intermediate HSV image is
+     * created and mask is only reallocated if the input size changes.
+     *
+     * With FUSED_HSV the result is identical to cv::cvtColor(COLOR_BGR2HSV) followed
+     * by cv::inRange, unless the hue range wraps around. With LOOKUP_TABLE each pixel is
+     * classified by the centre of its 8x8x8 BGR cell, so pixels close to the HSV bounds may differ.
+     */
+    void apply(const cv::Mat &input_img, cv::Mat &mask);
+    /**
+     * Same as apply(), but labels every pixel with 0 if it is in no class or with i + 1
+     * if it is in class i, so all classes are separated in a single pass
+     */
+    void applyLabels(const cv::Mat &input_img, cv::Mat &labels);
+    /**
+     * Classify a single BGR pixel against class 0, using the same fixed point
+     * arithmetic as the opencv 8 bit BGR to HSV conversion
+     */
+    inline bool isInRange(int b, int g, int r) const
+    {
+        const HsvRange &range = ranges_[0];
+        int v = std::max(b, std::max(g, r));
+        int diff = v - std::min(b, std::min(g, r));
+
+        if (v < range.thresh_min[2] || v > range.thresh_max[2])
+        {
+            return false;
+        }
+
+        int s = (diff * sdiv_table_[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        if (s < range.thresh_min[1] || s > range.thresh_max[1])
+        {
+            return false;
+        }
+
+        return isHueInRange(range, computeHue(b, g, r, v, diff));
+    }
+    /**
+     * Label of a single BGR pixel, 0 if it is in no class or i + 1 for class i
+     */
+    inline int classify(int b, int g, int r) const
+    {
+        int v = std::max(b, std::max(g, r));
+        int diff = v - std::min(b, std::min(g, r));
+        int s = (diff * sdiv_table_[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        int h = computeHue(b, g, r, v, diff);
+
+        for (size_t i = 0; i < ranges_.size(); i++)
+        {
+            const HsvRange &range = ranges_[i];
+            if (v >= range.thresh_min[2] && v <= range.thresh_max[2] &&
+                s >= range.thresh_min[1] && s <= range.thresh_max[1] && isHueInRange(range, h))
+            {
+                return static_cast<int>(i) + 1;
+            }
+        }
+        return 0;
+    }
+    /**
+     * Label of a single BGR pixel from the quantised table. Only valid after
+     * the table was built by apply() or applyLabels() in LOOKUP_TABLE mode
+     */
+    inline int lookUpLabel(int b, int g, int r) const
+    {
+        return lookup_table_[((b >> LUT_SHIFT) << (2 * LUT_BITS)) | ((g >> LUT_SHIFT) << LUT_BITS) | (r >> LUT_SHIFT)];
+    }
+
+private:
+    /**
+     * HSV bounds rounded to 8 bit, as done by cv::inRange
+     */
+    struct HsvRange
+    {
+        int thresh_min[3];
+        int thresh_max[3];
+        bool is_hue_wrapped;
+    };
+
+    HsvRange makeRange(const cv::Scalar &color_thresh_min, const cv::Scalar &color_thresh_max) const;
+
+    inline int computeHue(int b, int g, int r, int v, int diff) const
+    {
+        int h;
+        if (v == r)
+        {
+            h = g - b;
+        }
+        else if (v == g)
+        {
+            h = b - r + 2 * diff;
+        }
+        else
+        {
+            h = r - g + 4 * diff;
+        }
+        h = (h * hdiv_table_[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+        if (h < 0)
+        {
+            h += 180;
+        }
+        return h;
+    }
+
+    inline bool isHueInRange(const HsvRange &range, int h) const
+    {
+        if (range.is_hue_wrapped)
+        {
+            return (h >= range.thresh_min[0] || h <= range.thresh_max[0]);
+        }
+        return (h >= range.thresh_min[0] && h <= range.thresh_max[0]);
+    }
+
+    /**
+     * Fill the quantised table by classifying the centre colour of every cell
+     */
+    void buildLookupTable();
+
+private:
+    static const int HSV_SHIFT = 12;
+    /**
+     * Number of bits kept per colour channel in the lookup table
+     */
+    static const int LUT_BITS = 5;
+    static const int LUT_SHIFT = 8 - LUT_BITS;
+
+    /**
+     * Fixed point reciprocals used by opencv to compute S and H without divisions
+     */
+    int sdiv_table_[256];
+    int hdiv_table_[256];
+
+    /**
+     * Bounds of every class, there is always at least class 0
+     */
+    std::vector<HsvRange> ranges_;
+
+    Method method_;
+    /**
+     * Label of every quantised BGR cell (32x32x32 bytes = 32 KB)
+     */
+    std::vector<uchar> lookup_table_;
+    /**
+     * Set when the thresholds change; the table is rebuilt on the next call to apply()
+     */
+    bool is_lookup_table_outdated_;
+};
+
+#endif /* COLORTHRESHOLDFILTER_H_ */
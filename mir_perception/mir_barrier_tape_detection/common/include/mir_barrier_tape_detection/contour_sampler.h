@@ -0,0 +1,74 @@
+#ifndef CONTOURSAMPLER_H_
+#define CONTOURSAMPLER_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include <mir_barrier_tape_detection/barrier_tape_contours.h>
+
+/**
+ * Selects the pixels of the detected contours which are looked up in 3D
+ */
+class ContourSampler
+{
+public:
+    enum Policy
+    {
+        /**
+         * The box center followed by the contour points, of which only the first
+         * valid one per contour is meant to be used
+         */
+        FIRST_VALID = 0,
+        /**
+         * Points spaced uniformly by arc length along every contour
+         */
+        ARC_LENGTH = 1,
+        /**
+         * Grid of points inside the oriented box of every contour
+         */
+        BOX_FILL = 2,
+        /**
+         * Like ARC_LENGTH, but the spacing grows so that at most point_budget
+         * points are sampled in total over all classes
+         */
+        POINT_BUDGET = 3
+    };
+
+    ContourSampler();
+    virtual ~ContourSampler();
+    void setPolicy(Policy policy);
+    Policy getPolicy() const;
+    /**
+     * spacing: distance in pixels between samples for ARC_LENGTH and BOX_FILL, and the
+     *          minimum distance for POINT_BUDGET
+     * max_candidates: maximum number of pixels tried per contour for FIRST_VALID
+     * point_budget: maximum number of samples per frame for POINT_BUDGET
+     */
+    void setParameters(double spacing, int max_candidates, int point_budget);
+    /**
+     * Replace pixels with the samples of the contours of all colour classes, contour_ids
+     * with the contour each sample belongs to, numbered across the classes in order, and
+     * class_ids with its class. Samples are ordered by class and contour
+     */
+    void sample(const std::vector<BarrierTapeContours> &class_contours, std::vector<cv::Point> &pixels,
+                std::vector<int> &contour_ids, std::vector<int> &class_ids) const;
+
+private:
+    /**
+     * Walk along the closed contour at index and add a sample every spacing pixels,
+     * starting at its first point
+     */
+    void sampleArcLength(const BarrierTapeContours &contours, size_t index, int contour_id, double spacing,
+                         std::vector<cv::Point> &pixels, std::vector<int> &contour_ids) const;
+    void sampleBox(const BarrierTapeContours &contours, size_t index, int contour_id,
+                   std::vector<cv::Point> &pixels, std::vector<int> &contour_ids) const;
+    double contourLength(const BarrierTapeContours &contours, size_t contour_id) const;
+
+private:
+    Policy policy_;
+    double spacing_;
+    int max_candidates_;
+    int point_budget_;
+};
+
+#endif /* CONTOURSAMPLER_H_ */
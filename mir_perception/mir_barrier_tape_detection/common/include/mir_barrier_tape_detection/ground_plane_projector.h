@@ -0,0 +1,62 @@
+#ifndef GROUNDPLANEPROJECTOR_H_
+#define GROUNDPLANEPROJECTOR_H_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * Computes the 3D position of floor pixels without depth by intersecting their
+ * camera rays with the z = 0 plane of a ground frame.
+ *
+ * The points are returned in the camera frame, so they can be handled exactly
+ * like points read from a pointcloud.
+ */
+class GroundPlaneProjector
+{
+public:
+    GroundPlaneProjector();
+    virtual ~GroundPlaneProjector();
+    /**
+     * Intrinsics of the camera, as given by the K and D fields of sensor_msgs/CameraInfo.
+     * For a rectified image camera_matrix is the left 3x3 of P and distortion_coefficients
+     * is empty
+     */
+    void setCameraInfo(const cv::Matx33d &camera_matrix, const cv::Mat &distortion_coefficients);
+    bool hasCameraInfo() const;
+    /**
+     * Pose of the camera in the ground frame, i.e. ground_point = rotation * camera_point + translation
+     */
+    void setCameraPose(const cv::Matx33d &rotation, const cv::Vec3d &translation);
+    /**
+     * Rays which hit the ground further away from the camera than max_distance (in meters)
+     * are rejected, since close to the horizon small pixel errors cause large position errors
+     */
+    void setMaxDistance(double max_distance);
+    /**
+     * Intersect the rays of all pixels with the ground plane and append the intersections
+     * in the camera frame to xyz as consecutive x, y and z values. The index in pixels of
+     * every intersection is appended to valid_indices. Returns the number of intersections
+     */
+    size_t projectPoints(const std::vector<cv::Point> &pixels, std::vector<float> &xyz, std::vector<int> &valid_indices);
+
+private:
+    cv::Matx33d camera_matrix_;
+    cv::Mat distortion_coefficients_;
+    bool has_camera_info_;
+
+    /**
+     * Ground plane normal and offset expressed in the camera frame: a camera point p is on
+     * the ground if normal_.dot(p) + offset_ == 0
+     */
+    cv::Vec3d normal_;
+    double offset_;
+    double max_distance_;
+
+    /**
+     * Buffers reused across frames
+     */
+    std::vector<cv::Point2f> distorted_points_;
+    std::vector<cv::Point2f> normalized_points_;
+};
+
+#endif /* GROUNDPLANEPROJECTOR_H_ */
@@ -0,0 +1,98 @@
+#ifndef TEMPORALFUSIONGRID_H_
+#define TEMPORALFUSIONGRID_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Log-odds occupancy grid on the floor which fuses barrier tape detections over frames.
+ *
+ * Every frame, cells with a detection gain hit_log_odds and cells which were in view
+ * of the camera without a detection lose miss_log_odds. A cell is only reported as
+ * occupied once its log-odds reach occupied_log_odds, so a single false positive does
+ * not show up, and a detection which is no longer seen fades out. update() reports
+ * whether any cell changed its state, so the result only needs to be published then.
+ */
+class TemporalFusionGrid
+{
+public:
+    TemporalFusionGrid();
+    virtual ~TemporalFusionGrid();
+    /**
+     * cell_size: edge length of a cell in meters
+     * hit_log_odds: added to a cell with a detection in the frame (> 0)
+     * miss_log_odds: added to a cell in view without a detection in the frame (< 0)
+     * occupied_log_odds: threshold above which a cell is occupied
+     * max_log_odds: log-odds are clamped to [-max_log_odds, max_log_odds], which bounds
+     *               the number of frames needed to change the state of a cell
+     */
+    void setParameters(double cell_size, double hit_log_odds, double miss_log_odds, double occupied_log_odds,
+                       double max_log_odds);
+    /**
+     * Region observed in the current frame: a sector around the camera position (x, y)
+     * along the viewing direction, with the given half opening angle (radians) and range (meters)
+     */
+    void setView(double x, double y, double direction_x, double direction_y, double half_fov, double range);
+    /**
+     * Add a detection of the current frame; several detections in one cell count once
+     */
+    void addHit(const pcl::PointXYZ &point);
+    /**
+     * Apply the hits and misses of the current frame and start the next one.
+     * Returns true if any cell became occupied or free
+     */
+    bool update();
+    /**
+     * Number of consecutive frames in which no cell changed its state
+     */
+    int getNumStableFrames() const;
+    /**
+     * Replace the points of cloud with the mean detection of every occupied cell
+     */
+    void getOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud) const;
+    void clear();
+    size_t size() const;
+
+private:
+    typedef uint64_t CellKey;
+
+    struct Cell
+    {
+        pcl::PointXYZ mean;
+        int hits;
+        double log_odds;
+        bool is_occupied;
+        /**
+         * Frame in which the cell was last hit
+         */
+        uint64_t last_hit_frame;
+    };
+
+    CellKey computeKey(const pcl::PointXYZ &point) const;
+    bool isInView(const pcl::PointXYZ &point) const;
+
+private:
+    double cell_size_;
+    double hit_log_odds_;
+    double miss_log_odds_;
+    double occupied_log_odds_;
+    double max_log_odds_;
+
+    bool has_view_;
+    double view_x_;
+    double view_y_;
+    double view_direction_x_;
+    double view_direction_y_;
+    double view_cos_half_fov_;
+    double view_range_;
+
+    std::unordered_map<CellKey, Cell> cells_;
+    std::vector<CellKey> hit_keys_;
+    uint64_t frame_;
+    int num_stable_frames_;
+};
+
+#endif /* TEMPORALFUSIONGRID_H_ */
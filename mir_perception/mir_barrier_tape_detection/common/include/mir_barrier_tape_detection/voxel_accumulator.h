@@ -0,0 +1,94 @@
+#ifndef VOXELACCUMULATOR_H_
+#define VOXELACCUMULATOR_H_
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include <stdint.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Accumulates barrier tape points over time in a spatially hashed voxel grid.
+ *
+ * Each voxel keeps the mean of the points that fell into it, a hit count and the
+ * time it was last observed. The number of voxels is bounded: when the capacity is
+ * reached the least recently observed voxel is dropped. Voxels which have not been
+ * observed for longer than the decay time are removed, so the memory and the size of
+ * the published cloud depend on the tape area and not on the runtime.
+ */
+class VoxelAccumulator
+{
+public:
+    VoxelAccumulator();
+    virtual ~VoxelAccumulator();
+    /**
+     * voxel_size: edge length of a voxel in meters
+     * capacity: maximum number of voxels kept
+     * decay_time: voxels not observed for this many seconds are removed, 0 disables the decay
+     * min_hits: number of observations before a voxel is reported as occupied
+     */
+    void setParameters(double voxel_size, size_t capacity, double decay_time, int min_hits);
+    /**
+     * Add a point observed at the given time (in seconds)
+     */
+    void addPoint(const pcl::PointXYZ &point, double stamp);
+    /**
+     * Remove voxels which were last observed before stamp - decay_time
+     */
+    void decay(double stamp);
+    void clear();
+    /**
+     * Keep track of voxels which become occupied, see getNewlyOccupiedCloud()
+     */
+    void setTrackNewlyOccupied(bool is_tracking_newly_occupied);
+    /**
+     * Number of voxels currently stored, occupied or not
+     */
+    size_t size() const;
+    /**
+     * Replace the points of cloud with the mean point of every occupied voxel
+     */
+    void getOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud) const;
+    /**
+     * Replace the points of cloud with the voxels which became occupied since
+     * the previous call to this function. Requires setTrackNewlyOccupied(true)
+     */
+    void getNewlyOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud);
+
+private:
+    typedef uint64_t VoxelKey;
+
+    struct Voxel
+    {
+        pcl::PointXYZ mean;
+        int hits;
+        double last_seen;
+        /**
+         * Position in the list of voxels ordered by last_seen
+         */
+        std::list<VoxelKey>::iterator age_it;
+    };
+
+    VoxelKey computeKey(const pcl::PointXYZ &point) const;
+    void removeVoxel(VoxelKey key);
+
+private:
+    double voxel_size_;
+    size_t capacity_;
+    double decay_time_;
+    int min_hits_;
+
+    std::unordered_map<VoxelKey, Voxel> voxels_;
+    /**
+     * Keys ordered from least to most recently observed
+     */
+    std::list<VoxelKey> voxels_by_age_;
+    /**
+     * Keys of voxels which reached min_hits since the last call to getNewlyOccupiedCloud
+     */
+    std::vector<VoxelKey> newly_occupied_;
+    bool is_tracking_newly_occupied_;
+};
+
+#endif /* VOXELACCUMULATOR_H_ */
@@ -1,7 +1,23 @@
+#include <cmath>
+#include <limits>
+
 #include <mir_barrier_tape_detection/barrier_tape_detection.h>
 
+namespace
+{
+double elapsedMilliseconds(int64 start_tick)
+{
+    return (cv::getTickCount() - start_tick) * 1000.0 / cv::getTickFrequency();
+}
+}
+
 BarrierTapeDetection::BarrierTapeDetection()
+    : is_debug_mode_(false), min_area_(0.0), is_tracking_enabled_(false), full_search_interval_(10),
+      roi_margin_(20), roi_motion_margin_(0), frames_since_full_search_(0), detection_scale_(1),
+      extraction_method_(CANNY_CONTOURS), color_classes_(1)
 {
+    // equivalent to the 7x7 cv::GaussianBlur with sigma derived from the kernel size
+    blur_kernel_ = cv::getGaussianKernel(7, 0, CV_32F);
 }
 
 BarrierTapeDetection::~BarrierTapeDetection()
@@ -10,69 +26,317 @@ BarrierTapeDetection::~BarrierTapeDetection()
 
 void BarrierTapeDetection::preprocessImage(const cv::Mat &input_img, cv::Mat &output_img)
 {
-    cv::Mat hsv_img;
-    cv::Mat filtered_img;
+    int64 start_tick = cv::getTickCount();
+    color_filter_.apply(input_img, mask_img_);
+    stage_timings_.segmentation += elapsedMilliseconds(start_tick);
 
-    cv::cvtColor(input_img, hsv_img, cv::COLOR_BGR2HSV);
-    cv::inRange(hsv_img, color_thresh_min_, color_thresh_max_, filtered_img);
-    cv::GaussianBlur(filtered_img, output_img, cv::Size(7, 7), 0, 0 );
+    start_tick = cv::getTickCount();
+    cv::sepFilter2D(mask_img_, output_img, CV_8U, blur_kernel_, blur_kernel_);
+    stage_timings_.blur += elapsedMilliseconds(start_tick);
 }
 
-bool BarrierTapeDetection::detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, std::vector< std::vector<std::vector<int> > > &barrier_tape_pts)
+bool BarrierTapeDetection::detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, BarrierTapeContours &barrier_tape_contours)
 {
-    cv::Mat preprocessed_img;
-    cv::Mat edge_img;
-    cv::RotatedRect box;
-    std::vector<std::vector<cv::Point> > contours;
-    int count = 0;
-    bool has_detected_barrier_tape = false;
+    return detectClasses(input_img, output_img, &barrier_tape_contours, 1);
+}
+
+bool BarrierTapeDetection::detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img,
+                                             std::vector<BarrierTapeContours> &class_contours)
+{
+    class_contours.resize(color_classes_.size());
+    return detectClasses(input_img, output_img, class_contours.data(), class_contours.size());
+}
 
-    preprocessImage(input_img, preprocessed_img);
+bool BarrierTapeDetection::detectClasses(const cv::Mat &input_img, cv::Mat &output_img,
+                                         BarrierTapeContours *class_contours, size_t num_classes)
+{
+    for (size_t c = 0; c < num_classes; c++)
+    {
+        class_contours[c].clear();
+    }
+    stage_timings_ = BarrierTapeStageTimings();
 
     if (is_debug_mode_)
     {
-        output_img = cv::Mat::zeros(preprocessed_img.size(), preprocessed_img.type());
+        output_img = cv::Mat::zeros(input_img.size(), CV_8UC1);
     }
 
-    cv::Canny(preprocessed_img, edge_img, 50, 100);
-    cv::findContours(edge_img, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    cv::Rect full_image(0, 0, input_img.cols, input_img.rows);
+    bool is_full_search = !is_tracking_enabled_ || tracked_rois_.empty() ||
+                          frames_since_full_search_ >= full_search_interval_;
 
-    for (int i = 0; i < contours.size(); i++)
+    if (!is_full_search)
     {
-        std::vector<int> barrier_tape_box_center;
-        std::vector<std::vector<int> > barrier_tape_box_pts;
+        predictRois(full_image);
+        for (size_t i = 0; i < search_rois_.size(); i++)
+        {
+            detectInRegion(input_img, search_rois_[i], output_img, class_contours, num_classes);
+        }
+
+        // tracking lost, fall back to searching the full image
+        is_full_search = true;
+        for (size_t c = 0; c < num_classes; c++)
+        {
+            is_full_search = is_full_search && class_contours[c].empty();
+        }
+    }
+
+    if (is_full_search)
+    {
+        detectInRegion(input_img, full_image, output_img, class_contours, num_classes);
+        frames_since_full_search_ = 0;
+    }
+    frames_since_full_search_++;
+
+    bool has_detected_barrier_tape = false;
+    tracked_rois_.clear();
+    for (size_t c = 0; c < num_classes; c++)
+    {
+        for (size_t i = 0; i < class_contours[c].size(); i++)
+        {
+            tracked_rois_.push_back(class_contours[c].boxes[i].boundingRect());
+        }
+        has_detected_barrier_tape = has_detected_barrier_tape || !class_contours[c].empty();
+    }
+
+    return has_detected_barrier_tape;
+}
+
+void BarrierTapeDetection::detectInRegion(const cv::Mat &input_img, const cv::Rect &roi, cv::Mat &output_img,
+                                          BarrierTapeContours *class_contours, size_t num_classes)
+{
+    cv::Mat region = input_img(roi);
+    const cv::Mat *region_img = &region;
+    if (detection_scale_ > 1)
+    {
+        int64 start_tick = cv::getTickCount();
+        cv::resize(region, scaled_img_, cv::Size(roi.width / detection_scale_, roi.height / detection_scale_),
+                   0, 0, cv::INTER_AREA);
+        stage_timings_.downsampling += elapsedMilliseconds(start_tick);
+        region_img = &scaled_img_;
+    }
+
+    // a single class is thresholded directly into a mask, several classes are labelled in one
+    // pass and each class mask is then split off the label image
+    int64 start_tick = cv::getTickCount();
+    if (num_classes == 1)
+    {
+        color_filter_.apply(*region_img, mask_img_);
+    }
+    else
+    {
+        color_filter_.applyLabels(*region_img, class_labels_img_);
+    }
+    stage_timings_.segmentation += elapsedMilliseconds(start_tick);
 
-        box = minAreaRect(cv::Mat(contours[i]));
+    for (size_t c = 0; c < num_classes; c++)
+    {
+        if (num_classes > 1)
+        {
+            start_tick = cv::getTickCount();
+            cv::compare(class_labels_img_, static_cast<double>(c + 1), mask_img_, cv::CMP_EQ);
+            stage_timings_.segmentation += elapsedMilliseconds(start_tick);
+        }
+
+        if (extraction_method_ == CONNECTED_COMPONENTS)
+        {
+            extractComponents(mask_img_, roi, output_img, class_contours[c]);
+        }
+        else
+        {
+            extractEdgeContours(mask_img_, roi, output_img, class_contours[c]);
+        }
+    }
+}
+
+void BarrierTapeDetection::extractEdgeContours(const cv::Mat &mask_img, const cv::Rect &roi, cv::Mat &output_img,
+                                               BarrierTapeContours &barrier_tape_contours)
+{
+    int64 start_tick = cv::getTickCount();
+    cv::sepFilter2D(mask_img, preprocessed_img_, CV_8U, blur_kernel_, blur_kernel_);
+    stage_timings_.blur += elapsedMilliseconds(start_tick);
+
+    start_tick = cv::getTickCount();
+    cv::Canny(preprocessed_img_, edge_img_, 50, 100);
+    stage_timings_.edge_detection += elapsedMilliseconds(start_tick);
+
+    start_tick = cv::getTickCount();
+    if (detection_scale_ > 1)
+    {
+        cv::findContours(edge_img_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+        // map every point to the center of the full resolution block it was downsampled from
+        cv::Point offset = roi.tl() + cv::Point(detection_scale_ / 2, detection_scale_ / 2);
+        for (size_t i = 0; i < contours_.size(); i++)
+        {
+            for (size_t j = 0; j < contours_[i].size(); j++)
+            {
+                contours_[i][j] = contours_[i][j] * detection_scale_ + offset;
+            }
+        }
+    }
+    else
+    {
+        cv::findContours(edge_img_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE, roi.tl());
+    }
+    stage_timings_.contour_detection += elapsedMilliseconds(start_tick);
+
+    start_tick = cv::getTickCount();
+    for (int i = 0; i < contours_.size(); i++)
+    {
+        cv::RotatedRect box = cv::minAreaRect(contours_[i]);
 
         if ((box.size.height * box.size.width) < min_area_)
         {
             continue;
         }
 
-        barrier_tape_box_center.push_back(box.center.x);
-        barrier_tape_box_center.push_back(box.center.y);
-        barrier_tape_box_pts.push_back(barrier_tape_box_center);
-        //std::cout << "box center: " << box.center.x << ", " << box.center.y << std::endl;
+        barrier_tape_contours.addContour(contours_[i], box);
 
-        for (int j = 0; j < contours[i].size(); j++)
+        if (is_debug_mode_)
         {
-            std::vector<int> contour_pt;
-            contour_pt.push_back(contours[i][j].x);
-            contour_pt.push_back(contours[i][j].y);
-            barrier_tape_box_pts.push_back(contour_pt);
+            cv::drawContours(output_img, contours_, i, cv::Scalar(255, 255, 255), 2);
         }
-        barrier_tape_pts.push_back(barrier_tape_box_pts);
+    }
+    stage_timings_.box_fitting += elapsedMilliseconds(start_tick);
+}
+
+void BarrierTapeDetection::extractComponents(const cv::Mat &mask_img, const cv::Rect &roi, cv::Mat &output_img,
+                                             BarrierTapeContours &barrier_tape_contours)
+{
+    int64 start_tick = cv::getTickCount();
+    int num_labels = cv::connectedComponentsWithStats(mask_img, labels_img_, component_stats_, component_centroids_,
+                                                      8, CV_32S);
+    stage_timings_.contour_detection += elapsedMilliseconds(start_tick);
+
+    start_tick = cv::getTickCount();
+    float scale = static_cast<float>(detection_scale_);
+    double min_scaled_area = min_area_ / (scale * scale);
+    cv::Point offset = roi.tl() + cv::Point(detection_scale_ / 2, detection_scale_ / 2);
+
+    // label 0 is the background
+    for (int label = 1; label < num_labels; label++)
+    {
+        const int *stats = component_stats_.ptr<int>(label);
+        cv::Rect bbox(stats[cv::CC_STAT_LEFT], stats[cv::CC_STAT_TOP], stats[cv::CC_STAT_WIDTH], stats[cv::CC_STAT_HEIGHT]);
+
+        // the oriented box is never larger than the axis aligned one
+        if (bbox.area() < min_scaled_area)
+        {
+            continue;
+        }
+
+        cv::compare(labels_img_(bbox), label, component_mask_, cv::CMP_EQ);
+        cv::Moments moments = cv::moments(component_mask_, true);
+        if (moments.m00 <= 0.0)
+        {
+            continue;
+        }
+
+        // a rectangle of length l has a variance of l^2 / 12 along its axis
+        double mu20 = moments.mu20 / moments.m00;
+        double mu02 = moments.mu02 / moments.m00;
+        double mu11 = moments.mu11 / moments.m00;
+        double spread = std::sqrt(0.25 * (mu20 - mu02) * (mu20 - mu02) + mu11 * mu11);
+        double major_variance = 0.5 * (mu20 + mu02) + spread;
+        double minor_variance = std::max(0.5 * (mu20 + mu02) - spread, 0.0);
+        double angle = 0.5 * std::atan2(2.0 * mu11, mu20 - mu02) * 180.0 / CV_PI;
+
+        cv::Size2f size(std::sqrt(12.0 * major_variance), std::sqrt(12.0 * minor_variance));
+        if (size.area() < min_scaled_area)
+        {
+            continue;
+        }
+
+        cv::Point2f center(bbox.x + moments.m10 / moments.m00, bbox.y + moments.m01 / moments.m00);
+        cv::RotatedRect box(center * scale + cv::Point2f(offset), size * scale, angle);
+
+        cv::findContours(component_mask_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+        if (contours_.empty())
+        {
+            continue;
+        }
+
+        // the component is connected, so only holes could add further contours and those are not external
+        std::vector<cv::Point> &boundary = contours_[0];
+        cv::Point boundary_offset = bbox.tl() * detection_scale_ + offset;
+        for (size_t j = 0; j < boundary.size(); j++)
+        {
+            boundary[j] = boundary[j] * detection_scale_ + boundary_offset;
+        }
+        barrier_tape_contours.addContour(boundary, box);
 
         if (is_debug_mode_)
         {
-            cv::drawContours(output_img, contours, i, cv::Scalar(255, 255, 255), 2);
+            cv::drawContours(output_img, contours_, 0, cv::Scalar(255, 255, 255), 2);
+        }
+    }
+    stage_timings_.box_fitting += elapsedMilliseconds(start_tick);
+}
+
+void BarrierTapeDetection::predictRois(const cv::Rect &full_image)
+{
+    int margin = roi_margin_ + roi_motion_margin_;
+    int min_roi_size = MIN_ROI_SIZE * detection_scale_;
+
+    search_rois_.clear();
+    for (size_t i = 0; i < tracked_rois_.size(); i++)
+    {
+        cv::Rect roi(tracked_rois_[i].x - margin, tracked_rois_[i].y - margin,
+                     tracked_rois_[i].width + 2 * margin, tracked_rois_[i].height + 2 * margin);
+        roi &= full_image;
+
+        // too small for the blur and edge detection kernels
+        if (roi.width < min_roi_size || roi.height < min_roi_size)
+        {
+            continue;
         }
+        search_rois_.push_back(roi);
+    }
 
-        count++;
+    // merge overlapping regions so that no pixel is processed twice
+    bool has_merged = true;
+    while (has_merged)
+    {
+        has_merged = false;
+        for (size_t i = 0; i < search_rois_.size() && !has_merged; i++)
+        {
+            for (size_t j = i + 1; j < search_rois_.size(); j++)
+            {
+                if ((search_rois_[i] & search_rois_[j]).area() > 0)
+                {
+                    search_rois_[i] |= search_rois_[j];
+                    search_rois_.erase(search_rois_.begin() + j);
+                    has_merged = true;
+                    break;
+                }
+            }
+        }
     }
-    if (count > 0)
+}
+
+bool BarrierTapeDetection::detectBarrierTape(const cv::Mat &input_img, cv::Mat &output_img, std::vector< std::vector<std::vector<int> > > &barrier_tape_pts)
+{
+    bool has_detected_barrier_tape = detectBarrierTape(input_img, output_img, legacy_contours_);
+
+    for (size_t i = 0; i < legacy_contours_.size(); i++)
     {
-        has_detected_barrier_tape = true;
+        std::vector<std::vector<int> > barrier_tape_box_pts;
+
+        // the box center comes first, followed by the contour points
+        std::vector<int> barrier_tape_box_center;
+        barrier_tape_box_center.push_back(legacy_contours_.boxes[i].center.x);
+        barrier_tape_box_center.push_back(legacy_contours_.boxes[i].center.y);
+        barrier_tape_box_pts.push_back(barrier_tape_box_center);
+
+        for (const cv::Point *pt = legacy_contours_.contourBegin(i); pt != legacy_contours_.contourEnd(i); pt++)
+        {
+            std::vector<int> contour_pt;
+            contour_pt.push_back(pt->x);
+            contour_pt.push_back(pt->y);
+            barrier_tape_box_pts.push_back(contour_pt);
+        }
+        barrier_tape_pts.push_back(barrier_tape_box_pts);
     }
     return has_detected_barrier_tape;
 }
@@ -85,4 +349,100 @@ void BarrierTapeDetection::updateDynamicVariables(bool debug_mode, double min_ar
     // convert the given HSV threshold from the standard (360, 100, 100) range to the (180, 255, 255) opencv range
     color_thresh_min_ = cv::Scalar(color_thresh_min_h*0.5, color_thresh_min_s*2.55, color_thresh_min_v*2.55);
     color_thresh_max_ = cv::Scalar(color_thresh_max_h*0.5, color_thresh_max_s*2.55, color_thresh_max_v*2.55);
+    color_classes_[0] = ColorClass(color_thresh_min_, color_thresh_max_);
+    color_filter_.setClasses(color_classes_);
+}
+
+void BarrierTapeDetection::setAdditionalColorClasses(const std::vector<ColorClass> &color_classes)
+{
+    color_classes_.resize(1);
+    color_classes_.insert(color_classes_.end(), color_classes.begin(), color_classes.end());
+    color_filter_.setClasses(color_classes_);
+}
+
+size_t BarrierTapeDetection::getNumColorClasses() const
+{
+    return color_classes_.size();
+}
+
+void BarrierTapeDetection::setSegmentationMethod(int segmentation_method)
+{
+    color_filter_.setMethod(static_cast<ColorThresholdFilter::Method>(segmentation_method));
+}
+
+void BarrierTapeDetection::setTrackingParameters(bool is_tracking_enabled, int full_search_interval, int roi_margin)
+{
+    if (is_tracking_enabled != is_tracking_enabled_)
+    {
+        tracked_rois_.clear();
+    }
+    is_tracking_enabled_ = is_tracking_enabled;
+    full_search_interval_ = std::max(full_search_interval, 1);
+    roi_margin_ = std::max(roi_margin, 0);
+}
+
+void BarrierTapeDetection::setRoiMotionMargin(int roi_motion_margin)
+{
+    roi_motion_margin_ = std::max(roi_motion_margin, 0);
+}
+
+void BarrierTapeDetection::setDetectionScale(int detection_scale)
+{
+    if (detection_scale != 2 && detection_scale != 4)
+    {
+        detection_scale = 1;
+    }
+    if (detection_scale != detection_scale_)
+    {
+        tracked_rois_.clear();
+    }
+    detection_scale_ = detection_scale;
+}
+
+void BarrierTapeDetection::setExtractionMethod(int extraction_method)
+{
+    extraction_method_ = static_cast<ExtractionMethod>(extraction_method);
+}
+
+int BarrierTapeDetection::getDetectionScale() const
+{
+    return detection_scale_;
+}
+
+bool BarrierTapeDetection::refinePoint(const cv::Mat &input_img, cv::Point &pt, size_t class_id) const
+{
+    if (detection_scale_ == 1)
+    {
+        return true;
+    }
+
+    int radius = detection_scale_;
+    int best_distance = std::numeric_limits<int>::max();
+    cv::Point best_pt;
+    for (int y = std::max(pt.y - radius, 0); y <= std::min(pt.y + radius, input_img.rows - 1); y++)
+    {
+        const cv::Vec3b *row = input_img.ptr<cv::Vec3b>(y);
+        for (int x = std::max(pt.x - radius, 0); x <= std::min(pt.x + radius, input_img.cols - 1); x++)
+        {
+            int distance = (x - pt.x) * (x - pt.x) + (y - pt.y) * (y - pt.y);
+            if (distance < best_distance &&
+                color_filter_.classify(row[x][0], row[x][1], row[x][2]) == static_cast<int>(class_id) + 1)
+            {
+                best_distance = distance;
+                best_pt = cv::Point(x, y);
+            }
+        }
+    }
+
+    if (best_distance == std::numeric_limits<int>::max())
+    {
+        return false;
+    }
+    pt = best_pt;
+    return true;
+}
+
+const BarrierTapeStageTimings &BarrierTapeDetection::getStageTimings() const
+{
+    return stage_timings_;
 }
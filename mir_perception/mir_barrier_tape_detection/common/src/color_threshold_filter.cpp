@@ -0,0 +1,198 @@
+#include <mir_barrier_tape_detection/color_threshold_filter.h>
+
+namespace
+{
+/**
+ * Classifies a horizontal stripe of the input image. Rows are independent,
+ * so stripes are distributed over the available cores by cv::parallel_for_.
+ *
+ * In mask mode pixels of class 0 are set to 255, otherwise every pixel gets its label
+ */
+class ColorThresholdBody : public cv::ParallelLoopBody
+{
+public:
+    ColorThresholdBody(const ColorThresholdFilter &filter, const cv::Mat &input_img, cv::Mat &output,
+                       bool use_lookup_table, bool is_mask)
+        : filter_(filter), input_img_(input_img), output_(output), use_lookup_table_(use_lookup_table),
+          is_mask_(is_mask)
+    {
+    }
+
+    virtual void operator()(const cv::Range &range) const
+    {
+        for (int y = range.start; y < range.end; y++)
+        {
+            const uchar *src = input_img_.ptr<uchar>(y);
+            uchar *dst = output_.ptr<uchar>(y);
+
+            if (use_lookup_table_ && is_mask_)
+            {
+                for (int x = 0; x < input_img_.cols; x++, src += 3)
+                {
+                    dst[x] = (filter_.lookUpLabel(src[0], src[1], src[2]) == 1) ? 255 : 0;
+                }
+            }
+            else if (use_lookup_table_)
+            {
+                for (int x = 0; x < input_img_.cols; x++, src += 3)
+                {
+                    dst[x] = static_cast<uchar>(filter_.lookUpLabel(src[0], src[1], src[2]));
+                }
+            }
+            else if (is_mask_)
+            {
+                for (int x = 0; x < input_img_.cols; x++, src += 3)
+                {
+                    dst[x] = filter_.isInRange(src[0], src[1], src[2]) ? 255 : 0;
+                }
+            }
+            else
+            {
+                for (int x = 0; x < input_img_.cols; x++, src += 3)
+                {
+                    dst[x] = static_cast<uchar>(filter_.classify(src[0], src[1], src[2]));
+                }
+            }
+        }
+    }
+
+private:
+    const ColorThresholdFilter &filter_;
+    const cv::Mat &input_img_;
+    cv::Mat &output_;
+    bool use_lookup_table_;
+    bool is_mask_;
+};
+}
+
+ColorThresholdFilter::ColorThresholdFilter()
+    : ranges_(1), method_(FUSED_HSV), lookup_table_(1 << (3 * LUT_BITS), 0), is_lookup_table_outdated_(true)
+{
+    // same reciprocal tables as the opencv RGB2HSV_b conversion for the 180 hue range
+    sdiv_table_[0] = hdiv_table_[0] = 0;
+    for (int i = 1; i < 256; i++)
+    {
+        sdiv_table_[i] = cv::saturate_cast<int>((255 << HSV_SHIFT) / (1. * i));
+        hdiv_table_[i] = cv::saturate_cast<int>((180 << HSV_SHIFT) / (6. * i));
+    }
+    setThresholds(cv::Scalar::all(0), cv::Scalar::all(0));
+}
+
+ColorThresholdFilter::~ColorThresholdFilter()
+{
+}
+
+ColorThresholdFilter::HsvRange ColorThresholdFilter::makeRange(const cv::Scalar &color_thresh_min,
+                                                               const cv::Scalar &color_thresh_max) const
+{
+    HsvRange range;
+    range.is_hue_wrapped = false;
+    for (int i = 0; i < 3; i++)
+    {
+        int lower = cvRound(color_thresh_min[i]);
+        int upper = cvRound(color_thresh_max[i]);
+
+        if (i == 0 && lower > upper && lower <= 180 && upper >= 0)
+        {
+            // hue range across 0, e.g. red from 170 to 10
+            range.is_hue_wrapped = true;
+            range.thresh_min[i] = std::max(lower, 0);
+            range.thresh_max[i] = std::min(upper, 255);
+        }
+        // cv::inRange treats an inverted or out of range interval as empty
+        else if (lower > upper || lower > 255 || upper < 0)
+        {
+            range.thresh_min[i] = 1;
+            range.thresh_max[i] = 0;
+        }
+        else
+        {
+            range.thresh_min[i] = std::max(lower, 0);
+            range.thresh_max[i] = std::min(upper, 255);
+        }
+    }
+    return range;
+}
+
+void ColorThresholdFilter::setThresholds(const cv::Scalar &color_thresh_min, const cv::Scalar &color_thresh_max)
+{
+    ranges_[0] = makeRange(color_thresh_min, color_thresh_max);
+    is_lookup_table_outdated_ = true;
+}
+
+void ColorThresholdFilter::setClasses(const std::vector<ColorClass> &color_classes)
+{
+    CV_Assert(!color_classes.empty() && color_classes.size() < 256);
+
+    ranges_.resize(color_classes.size());
+    for (size_t i = 0; i < color_classes.size(); i++)
+    {
+        ranges_[i] = makeRange(color_classes[i].thresh_min, color_classes[i].thresh_max);
+    }
+    is_lookup_table_outdated_ = true;
+}
+
+size_t ColorThresholdFilter::getNumClasses() const
+{
+    return ranges_.size();
+}
+
+void ColorThresholdFilter::setMethod(Method method)
+{
+    method_ = method;
+}
+
+ColorThresholdFilter::Method ColorThresholdFilter::getMethod() const
+{
+    return method_;
+}
+
+void ColorThresholdFilter::buildLookupTable()
+{
+    const int cells_per_channel = 1 << LUT_BITS;
+    const int half_cell = 1 << (LUT_SHIFT - 1);
+
+    for (int b = 0; b < cells_per_channel; b++)
+    {
+        for (int g = 0; g < cells_per_channel; g++)
+        {
+            for (int r = 0; r < cells_per_channel; r++)
+            {
+                int index = (b << (2 * LUT_BITS)) | (g << LUT_BITS) | r;
+                lookup_table_[index] = static_cast<uchar>(classify((b << LUT_SHIFT) + half_cell,
+                                                                   (g << LUT_SHIFT) + half_cell,
+                                                                   (r << LUT_SHIFT) + half_cell));
+            }
+        }
+    }
+    is_lookup_table_outdated_ = false;
+}
+
+void ColorThresholdFilter::apply(const cv::Mat &input_img, cv::Mat &mask)
+{
+    CV_Assert(input_img.type() == CV_8UC3);
+
+    bool use_lookup_table = (method_ == LOOKUP_TABLE);
+    if (use_lookup_table && is_lookup_table_outdated_)
+    {
+        buildLookupTable();
+    }
+
+    mask.create(input_img.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, input_img.rows), ColorThresholdBody(*this, input_img, mask, use_lookup_table, true));
+}
+
+void ColorThresholdFilter::applyLabels(const cv::Mat &input_img, cv::Mat &labels)
+{
+    CV_Assert(input_img.type() == CV_8UC3);
+
+    bool use_lookup_table = (method_ == LOOKUP_TABLE);
+    if (use_lookup_table && is_lookup_table_outdated_)
+    {
+        buildLookupTable();
+    }
+
+    labels.create(input_img.size(), CV_8UC1);
+    cv::parallel_for_(cv::Range(0, input_img.rows),
+                      ColorThresholdBody(*this, input_img, labels, use_lookup_table, false));
+}
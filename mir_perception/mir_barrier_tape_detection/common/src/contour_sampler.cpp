@@ -0,0 +1,166 @@
+#include <cmath>
+
+#include <mir_barrier_tape_detection/contour_sampler.h>
+
+ContourSampler::ContourSampler() : policy_(FIRST_VALID), spacing_(30.0), max_candidates_(30), point_budget_(500)
+{
+}
+
+ContourSampler::~ContourSampler()
+{
+}
+
+void ContourSampler::setPolicy(Policy policy)
+{
+    policy_ = policy;
+}
+
+ContourSampler::Policy ContourSampler::getPolicy() const
+{
+    return policy_;
+}
+
+void ContourSampler::setParameters(double spacing, int max_candidates, int point_budget)
+{
+    spacing_ = std::max(spacing, 1.0);
+    max_candidates_ = std::max(max_candidates, 1);
+    point_budget_ = std::max(point_budget, 1);
+}
+
+void ContourSampler::sample(const std::vector<BarrierTapeContours> &class_contours, std::vector<cv::Point> &pixels,
+                            std::vector<int> &contour_ids, std::vector<int> &class_ids) const
+{
+    pixels.clear();
+    contour_ids.clear();
+    class_ids.clear();
+
+    double spacing = spacing_;
+    if (policy_ == POINT_BUDGET)
+    {
+        // a single spacing for the contours of all classes, so the budget holds for the whole frame
+        double total_length = 0.0;
+        size_t num_contours = 0;
+        for (size_t c = 0; c < class_contours.size(); c++)
+        {
+            for (size_t i = 0; i < class_contours[c].size(); i++)
+            {
+                total_length += contourLength(class_contours[c], i);
+            }
+            num_contours += class_contours[c].size();
+        }
+        // every contour gets at least its first point
+        int budget = std::max(point_budget_ - static_cast<int>(num_contours), 1);
+        spacing = std::max(spacing, total_length / budget);
+    }
+
+    int first_contour_id = 0;
+    for (size_t c = 0; c < class_contours.size(); c++)
+    {
+        const BarrierTapeContours &contours = class_contours[c];
+        for (size_t i = 0; i < contours.size(); i++)
+        {
+            int contour_id = first_contour_id + static_cast<int>(i);
+            if (policy_ == FIRST_VALID)
+            {
+                const cv::Point2f &box_center = contours.boxes[i].center;
+                pixels.push_back(cv::Point(static_cast<int>(box_center.x), static_cast<int>(box_center.y)));
+                contour_ids.push_back(contour_id);
+
+                int num_points = std::min(contours.contourSize(i), max_candidates_ - 1);
+                const cv::Point *contour = contours.contourBegin(i);
+                for (int j = 0; j < num_points; j++)
+                {
+                    pixels.push_back(contour[j]);
+                    contour_ids.push_back(contour_id);
+                }
+            }
+            else if (policy_ == BOX_FILL)
+            {
+                sampleBox(contours, i, contour_id, pixels, contour_ids);
+            }
+            else
+            {
+                sampleArcLength(contours, i, contour_id, spacing, pixels, contour_ids);
+            }
+        }
+        first_contour_id += static_cast<int>(contours.size());
+        class_ids.resize(pixels.size(), static_cast<int>(c));
+    }
+}
+
+double ContourSampler::contourLength(const BarrierTapeContours &contours, size_t contour_id) const
+{
+    const cv::Point *contour = contours.contourBegin(contour_id);
+    int num_points = contours.contourSize(contour_id);
+
+    double length = 0.0;
+    for (int j = 0; j < num_points; j++)
+    {
+        cv::Point delta = contour[(j + 1) % num_points] - contour[j];
+        length += std::sqrt(static_cast<double>(delta.x * delta.x + delta.y * delta.y));
+    }
+    return length;
+}
+
+void ContourSampler::sampleArcLength(const BarrierTapeContours &contours, size_t index, int contour_id,
+                                     double spacing, std::vector<cv::Point> &pixels,
+                                     std::vector<int> &contour_ids) const
+{
+    const cv::Point *contour = contours.contourBegin(index);
+    int num_points = contours.contourSize(index);
+    if (num_points == 0)
+    {
+        return;
+    }
+    if (num_points == 1)
+    {
+        pixels.push_back(contour[0]);
+        contour_ids.push_back(contour_id);
+        return;
+    }
+
+    // the contours are approximated by their vertices, so samples are interpolated along the segments
+    double distance_to_next_sample = 0.0;
+    for (int j = 0; j < num_points; j++)
+    {
+        cv::Point2d start = contour[j];
+        cv::Point2d delta = cv::Point2d(contour[(j + 1) % num_points]) - start;
+        double segment_length = std::sqrt(delta.x * delta.x + delta.y * delta.y);
+
+        double position = distance_to_next_sample;
+        while (position < segment_length)
+        {
+            double t = position / segment_length;
+            pixels.push_back(cv::Point(cvRound(start.x + t * delta.x), cvRound(start.y + t * delta.y)));
+            contour_ids.push_back(contour_id);
+            position += spacing;
+        }
+        distance_to_next_sample = position - segment_length;
+    }
+}
+
+void ContourSampler::sampleBox(const BarrierTapeContours &contours, size_t index, int contour_id,
+                               std::vector<cv::Point> &pixels, std::vector<int> &contour_ids) const
+{
+    const cv::RotatedRect &box = contours.boxes[index];
+    double angle = box.angle * CV_PI / 180.0;
+    cv::Point2d width_axis(std::cos(angle), std::sin(angle));
+    cv::Point2d height_axis(-std::sin(angle), std::cos(angle));
+
+    // samples are centered in the box, a box narrower than the spacing gets a single row
+    int num_columns = std::max(static_cast<int>(box.size.width / spacing_), 0) + 1;
+    int num_rows = std::max(static_cast<int>(box.size.height / spacing_), 0) + 1;
+    double first_column = -0.5 * (num_columns - 1) * spacing_;
+    double first_row = -0.5 * (num_rows - 1) * spacing_;
+
+    for (int row = 0; row < num_rows; row++)
+    {
+        for (int column = 0; column < num_columns; column++)
+        {
+            cv::Point2d pt = cv::Point2d(box.center) + width_axis * (first_column + column * spacing_)
+                             + height_axis * (first_row + row * spacing_);
+            pixels.push_back(cv::Point(cvRound(pt.x), cvRound(pt.y)));
+            contour_ids.push_back(contour_id);
+        }
+    }
+}
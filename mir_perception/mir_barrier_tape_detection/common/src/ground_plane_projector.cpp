@@ -0,0 +1,88 @@
+#include <mir_barrier_tape_detection/ground_plane_projector.h>
+
+GroundPlaneProjector::GroundPlaneProjector()
+    : camera_matrix_(cv::Matx33d::eye()), has_camera_info_(false), normal_(0.0, 0.0, 1.0), offset_(0.0),
+      max_distance_(5.0)
+{
+}
+
+GroundPlaneProjector::~GroundPlaneProjector()
+{
+}
+
+void GroundPlaneProjector::setCameraInfo(const cv::Matx33d &camera_matrix, const cv::Mat &distortion_coefficients)
+{
+    camera_matrix_ = camera_matrix;
+    distortion_coefficients_ = distortion_coefficients.clone();
+    // an uncalibrated camera publishes a zero camera matrix
+    has_camera_info_ = (camera_matrix(0, 0) > 0.0 && camera_matrix(1, 1) > 0.0);
+}
+
+bool GroundPlaneProjector::hasCameraInfo() const
+{
+    return has_camera_info_;
+}
+
+void GroundPlaneProjector::setCameraPose(const cv::Matx33d &rotation, const cv::Vec3d &translation)
+{
+    // the ground plane z = 0 transformed into the camera frame
+    normal_ = cv::Vec3d(rotation(2, 0), rotation(2, 1), rotation(2, 2));
+    offset_ = translation[2];
+}
+
+void GroundPlaneProjector::setMaxDistance(double max_distance)
+{
+    max_distance_ = max_distance;
+}
+
+size_t GroundPlaneProjector::projectPoints(const std::vector<cv::Point> &pixels, std::vector<float> &xyz,
+                                           std::vector<int> &valid_indices)
+{
+    if (!has_camera_info_ || pixels.empty())
+    {
+        return 0;
+    }
+
+    // normalized image coordinates of all pixels at once
+    distorted_points_.assign(pixels.begin(), pixels.end());
+    if (distortion_coefficients_.empty())
+    {
+        normalized_points_.resize(pixels.size());
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            normalized_points_[i].x = (distorted_points_[i].x - camera_matrix_(0, 2)) / camera_matrix_(0, 0);
+            normalized_points_[i].y = (distorted_points_[i].y - camera_matrix_(1, 2)) / camera_matrix_(1, 1);
+        }
+    }
+    else
+    {
+        cv::undistortPoints(distorted_points_, normalized_points_, cv::Mat(camera_matrix_), distortion_coefficients_);
+    }
+
+    size_t num_valid = 0;
+    xyz.reserve(xyz.size() + 3 * pixels.size());
+    for (size_t i = 0; i < normalized_points_.size(); i++)
+    {
+        // the ray is s * (x, y, 1), intersect it with normal.dot(p) + offset = 0
+        cv::Vec3d ray(normalized_points_[i].x, normalized_points_[i].y, 1.0);
+        double denominator = normal_.dot(ray);
+        if (std::abs(denominator) < 1e-9)
+        {
+            continue;
+        }
+
+        double s = -offset_ / denominator;
+        cv::Vec3d point = ray * s;
+        if (s <= 0.0 || cv::norm(point) > max_distance_)
+        {
+            continue;
+        }
+
+        xyz.push_back(static_cast<float>(point[0]));
+        xyz.push_back(static_cast<float>(point[1]));
+        xyz.push_back(static_cast<float>(point[2]));
+        valid_indices.push_back(static_cast<int>(i));
+        num_valid++;
+    }
+    return num_valid;
+}
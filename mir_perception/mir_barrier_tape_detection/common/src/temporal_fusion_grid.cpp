@@ -0,0 +1,189 @@
+#include <mir_barrier_tape_detection/temporal_fusion_grid.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+/**
+ * Each cell index is stored in 32 bits of the key, the grid covers the floor only
+ */
+const int KEY_BITS = 32;
+const int64_t KEY_OFFSET = static_cast<int64_t>(1) << (KEY_BITS - 1);
+const int64_t KEY_MASK = (static_cast<int64_t>(1) << KEY_BITS) - 1;
+}
+
+TemporalFusionGrid::TemporalFusionGrid()
+    : cell_size_(0.05), hit_log_odds_(0.85), miss_log_odds_(-0.4), occupied_log_odds_(2.0), max_log_odds_(3.5),
+      has_view_(false), view_x_(0.0), view_y_(0.0), view_direction_x_(1.0), view_direction_y_(0.0),
+      view_cos_half_fov_(1.0), view_range_(0.0), frame_(1), num_stable_frames_(0)
+{
+}
+
+TemporalFusionGrid::~TemporalFusionGrid()
+{
+}
+
+void TemporalFusionGrid::setParameters(double cell_size, double hit_log_odds, double miss_log_odds,
+                                       double occupied_log_odds, double max_log_odds)
+{
+    if (cell_size != cell_size_)
+    {
+        // existing keys refer to the old grid
+        clear();
+    }
+    cell_size_ = cell_size;
+    hit_log_odds_ = std::max(hit_log_odds, 0.0);
+    miss_log_odds_ = std::min(miss_log_odds, 0.0);
+    max_log_odds_ = std::max(max_log_odds, hit_log_odds_);
+    occupied_log_odds_ = std::min(occupied_log_odds, max_log_odds_);
+}
+
+void TemporalFusionGrid::setView(double x, double y, double direction_x, double direction_y, double half_fov,
+                                 double range)
+{
+    double direction_norm = std::sqrt(direction_x * direction_x + direction_y * direction_y);
+    if (direction_norm < 1e-6)
+    {
+        // looking straight down or up, the view on the floor has no direction
+        has_view_ = false;
+        return;
+    }
+
+    has_view_ = true;
+    view_x_ = x;
+    view_y_ = y;
+    view_direction_x_ = direction_x / direction_norm;
+    view_direction_y_ = direction_y / direction_norm;
+    view_cos_half_fov_ = std::cos(half_fov);
+    view_range_ = range;
+}
+
+TemporalFusionGrid::CellKey TemporalFusionGrid::computeKey(const pcl::PointXYZ &point) const
+{
+    int64_t ix = static_cast<int64_t>(std::floor(point.x / cell_size_)) + KEY_OFFSET;
+    int64_t iy = static_cast<int64_t>(std::floor(point.y / cell_size_)) + KEY_OFFSET;
+
+    return (static_cast<CellKey>(ix & KEY_MASK) << KEY_BITS) | static_cast<CellKey>(iy & KEY_MASK);
+}
+
+bool TemporalFusionGrid::isInView(const pcl::PointXYZ &point) const
+{
+    if (!has_view_)
+    {
+        return false;
+    }
+
+    double dx = point.x - view_x_;
+    double dy = point.y - view_y_;
+    double distance = std::sqrt(dx * dx + dy * dy);
+    if (distance > view_range_)
+    {
+        return false;
+    }
+    return distance < 1e-6 || (dx * view_direction_x_ + dy * view_direction_y_) >= view_cos_half_fov_ * distance;
+}
+
+void TemporalFusionGrid::addHit(const pcl::PointXYZ &point)
+{
+    CellKey key = computeKey(point);
+    std::unordered_map<CellKey, Cell>::iterator it = cells_.find(key);
+
+    if (it == cells_.end())
+    {
+        Cell cell;
+        cell.mean = point;
+        cell.hits = 1;
+        cell.log_odds = 0.0;
+        cell.is_occupied = false;
+        cell.last_hit_frame = frame_;
+        cells_.insert(std::make_pair(key, cell));
+        hit_keys_.push_back(key);
+        return;
+    }
+
+    Cell &cell = it->second;
+    cell.hits++;
+    cell.mean.x += (point.x - cell.mean.x) / cell.hits;
+    cell.mean.y += (point.y - cell.mean.y) / cell.hits;
+    cell.mean.z += (point.z - cell.mean.z) / cell.hits;
+    if (cell.last_hit_frame != frame_)
+    {
+        cell.last_hit_frame = frame_;
+        hit_keys_.push_back(key);
+    }
+}
+
+bool TemporalFusionGrid::update()
+{
+    bool has_changed = false;
+
+    for (size_t i = 0; i < hit_keys_.size(); i++)
+    {
+        Cell &cell = cells_[hit_keys_[i]];
+        cell.log_odds = std::min(cell.log_odds + hit_log_odds_, max_log_odds_);
+    }
+
+    std::unordered_map<CellKey, Cell>::iterator it = cells_.begin();
+    while (it != cells_.end())
+    {
+        Cell &cell = it->second;
+        if (cell.last_hit_frame != frame_ && isInView(cell.mean))
+        {
+            cell.log_odds = std::max(cell.log_odds + miss_log_odds_, -max_log_odds_);
+        }
+
+        bool is_occupied = (cell.log_odds >= occupied_log_odds_);
+        if (is_occupied != cell.is_occupied)
+        {
+            cell.is_occupied = is_occupied;
+            has_changed = true;
+        }
+
+        // confidently free cells carry no more information than unknown ones
+        if (!cell.is_occupied && cell.log_odds <= 0.0 && cell.last_hit_frame != frame_)
+        {
+            it = cells_.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    hit_keys_.clear();
+    frame_++;
+    num_stable_frames_ = has_changed ? 0 : num_stable_frames_ + 1;
+    return has_changed;
+}
+
+int TemporalFusionGrid::getNumStableFrames() const
+{
+    return num_stable_frames_;
+}
+
+void TemporalFusionGrid::getOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud) const
+{
+    cloud.points.clear();
+    for (std::unordered_map<CellKey, Cell>::const_iterator it = cells_.begin(); it != cells_.end(); ++it)
+    {
+        if (it->second.is_occupied)
+        {
+            cloud.points.push_back(it->second.mean);
+        }
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+void TemporalFusionGrid::clear()
+{
+    cells_.clear();
+    hit_keys_.clear();
+    num_stable_frames_ = 0;
+}
+
+size_t TemporalFusionGrid::size() const
+{
+    return cells_.size();
+}
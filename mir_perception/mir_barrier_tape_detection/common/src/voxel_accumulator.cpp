@@ -0,0 +1,168 @@
+#include <mir_barrier_tape_detection/voxel_accumulator.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+/**
+ * Each voxel index is stored in 21 bits of the key, which covers +-20 km with 2 cm voxels
+ */
+const int KEY_BITS = 21;
+const int64_t KEY_OFFSET = 1 << (KEY_BITS - 1);
+const int64_t KEY_MASK = (1 << KEY_BITS) - 1;
+}
+
+VoxelAccumulator::VoxelAccumulator()
+    : voxel_size_(0.02), capacity_(20000), decay_time_(0.0), min_hits_(1), is_tracking_newly_occupied_(false)
+{
+}
+
+VoxelAccumulator::~VoxelAccumulator()
+{
+}
+
+void VoxelAccumulator::setParameters(double voxel_size, size_t capacity, double decay_time, int min_hits)
+{
+    if (voxel_size != voxel_size_)
+    {
+        // existing keys refer to the old grid
+        clear();
+    }
+    voxel_size_ = voxel_size;
+    capacity_ = std::max<size_t>(capacity, 1);
+    decay_time_ = decay_time;
+    min_hits_ = std::max(min_hits, 1);
+
+    voxels_.reserve(capacity_);
+    while (voxels_.size() > capacity_)
+    {
+        removeVoxel(voxels_by_age_.front());
+    }
+}
+
+VoxelAccumulator::VoxelKey VoxelAccumulator::computeKey(const pcl::PointXYZ &point) const
+{
+    int64_t ix = static_cast<int64_t>(std::floor(point.x / voxel_size_)) + KEY_OFFSET;
+    int64_t iy = static_cast<int64_t>(std::floor(point.y / voxel_size_)) + KEY_OFFSET;
+    int64_t iz = static_cast<int64_t>(std::floor(point.z / voxel_size_)) + KEY_OFFSET;
+
+    return (static_cast<VoxelKey>(ix & KEY_MASK) << (2 * KEY_BITS)) |
+           (static_cast<VoxelKey>(iy & KEY_MASK) << KEY_BITS) |
+           static_cast<VoxelKey>(iz & KEY_MASK);
+}
+
+void VoxelAccumulator::addPoint(const pcl::PointXYZ &point, double stamp)
+{
+    VoxelKey key = computeKey(point);
+    std::unordered_map<VoxelKey, Voxel>::iterator it = voxels_.find(key);
+
+    if (it == voxels_.end())
+    {
+        if (voxels_.size() >= capacity_)
+        {
+            removeVoxel(voxels_by_age_.front());
+        }
+
+        Voxel voxel;
+        voxel.mean = point;
+        voxel.hits = 1;
+        voxel.last_seen = stamp;
+        voxel.age_it = voxels_by_age_.insert(voxels_by_age_.end(), key);
+        voxels_.insert(std::make_pair(key, voxel));
+
+        if (min_hits_ == 1 && is_tracking_newly_occupied_)
+        {
+            newly_occupied_.push_back(key);
+        }
+        return;
+    }
+
+    Voxel &voxel = it->second;
+    voxel.hits++;
+    float weight = 1.0f / voxel.hits;
+    voxel.mean.x += (point.x - voxel.mean.x) * weight;
+    voxel.mean.y += (point.y - voxel.mean.y) * weight;
+    voxel.mean.z += (point.z - voxel.mean.z) * weight;
+    voxel.last_seen = stamp;
+    voxels_by_age_.splice(voxels_by_age_.end(), voxels_by_age_, voxel.age_it);
+
+    if (voxel.hits == min_hits_ && is_tracking_newly_occupied_)
+    {
+        newly_occupied_.push_back(key);
+    }
+}
+
+void VoxelAccumulator::decay(double stamp)
+{
+    if (decay_time_ <= 0.0)
+    {
+        return;
+    }
+
+    while (!voxels_by_age_.empty() && voxels_.find(voxels_by_age_.front())->second.last_seen < stamp - decay_time_)
+    {
+        removeVoxel(voxels_by_age_.front());
+    }
+}
+
+void VoxelAccumulator::removeVoxel(VoxelKey key)
+{
+    std::unordered_map<VoxelKey, Voxel>::iterator it = voxels_.find(key);
+    if (it == voxels_.end())
+    {
+        return;
+    }
+    voxels_by_age_.erase(it->second.age_it);
+    voxels_.erase(it);
+}
+
+void VoxelAccumulator::clear()
+{
+    voxels_.clear();
+    voxels_by_age_.clear();
+    newly_occupied_.clear();
+}
+
+void VoxelAccumulator::setTrackNewlyOccupied(bool is_tracking_newly_occupied)
+{
+    is_tracking_newly_occupied_ = is_tracking_newly_occupied;
+    newly_occupied_.clear();
+}
+
+size_t VoxelAccumulator::size() const
+{
+    return voxels_.size();
+}
+
+void VoxelAccumulator::getOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud) const
+{
+    cloud.points.clear();
+    for (std::unordered_map<VoxelKey, Voxel>::const_iterator it = voxels_.begin(); it != voxels_.end(); ++it)
+    {
+        if (it->second.hits >= min_hits_)
+        {
+            cloud.points.push_back(it->second.mean);
+        }
+    }
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
+
+void VoxelAccumulator::getNewlyOccupiedCloud(pcl::PointCloud<pcl::PointXYZ> &cloud)
+{
+    cloud.points.clear();
+    for (size_t i = 0; i < newly_occupied_.size(); i++)
+    {
+        // the voxel may have been evicted since it became occupied
+        std::unordered_map<VoxelKey, Voxel>::const_iterator it = voxels_.find(newly_occupied_[i]);
+        if (it != voxels_.end())
+        {
+            cloud.points.push_back(it->second.mean);
+        }
+    }
+    newly_occupied_.clear();
+    cloud.width = cloud.points.size();
+    cloud.height = 1;
+    cloud.is_dense = true;
+}
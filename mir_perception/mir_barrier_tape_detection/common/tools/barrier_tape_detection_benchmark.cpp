@@ -0,0 +1,777 @@
+/*
+ * Measures the per-frame cost of the barrier tape detection stages on
+ * synthetic frames at VGA and 1080p resolution, or on a directory of
+ * recorded BGR frames, the recall of the downsampled detection scales and
+ * of the contour extraction methods, and the cost of detecting several
+ * colour classes at once.
+ *
+ * With a frame directory the detections can be written as golden contour
+ * sets and later compared against them, so that optimisations which change
+ * the results are caught.
+ *
+ * Usage: barrier_tape_detection_benchmark [options]
+ *   --iterations N              frames to average over (default 100)
+ *   --frames DIR                recorded frames (png/jpg) instead of synthetic frames
+ *   --thresholds H S V H S V    min and max thresholds as in BarrierTapeDetection.cfg
+ *   --min-area A                minimum contour area (default 100)
+ *   --write-golden DIR          write the detections of each frame to DIR
+ *   --golden DIR                compare the detections of each frame with DIR,
+ *                               exits with 1 on a mismatch
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <mir_barrier_tape_detection/barrier_tape_detection.h>
+#include <mir_barrier_tape_detection/color_threshold_filter.h>
+
+/**
+ * Number of heap allocations made through operator new (std containers)
+ * and through the cv::Mat allocator (image buffers)
+ */
+static std::atomic<size_t> num_allocations(0);
+
+void *operator new(size_t size)
+{
+    num_allocations++;
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+namespace
+{
+/**
+ * Forwards to the default opencv allocator and counts newly allocated buffers
+ */
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    CountingMatAllocator() : std_allocator_(cv::Mat::getStdAllocator())
+    {
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           int flags, cv::UMatUsageFlags usage_flags) const
+    {
+        if (!data)
+        {
+            num_allocations++;
+        }
+        return std_allocator_->allocate(dims, sizes, type, data, step, flags, usage_flags);
+    }
+
+    bool allocate(cv::UMatData *data, int access_flags, cv::UMatUsageFlags usage_flags) const
+    {
+        return std_allocator_->allocate(data, access_flags, usage_flags);
+    }
+
+    void deallocate(cv::UMatData *data) const
+    {
+        std_allocator_->deallocate(data);
+    }
+
+private:
+    cv::MatAllocator *std_allocator_;
+};
+
+/**
+ * Thresholds in the units of BarrierTapeDetection.cfg, i.e. H in degrees and S, V in percent
+ */
+struct DetectionSettings
+{
+    int thresh_min[3];
+    int thresh_max[3];
+    double min_area;
+
+    DetectionSettings() : min_area(100)
+    {
+        // defaults of BarrierTapeDetection.cfg
+        thresh_min[0] = 40;
+        thresh_min[1] = 50;
+        thresh_min[2] = 90;
+        thresh_max[0] = 70;
+        thresh_max[1] = 100;
+        thresh_max[2] = 100;
+    }
+
+    cv::Scalar minScalar() const
+    {
+        return cv::Scalar(thresh_min[0] * 0.5, thresh_min[1] * 2.55, thresh_min[2] * 2.55);
+    }
+
+    cv::Scalar maxScalar() const
+    {
+        return cv::Scalar(thresh_max[0] * 0.5, thresh_max[1] * 2.55, thresh_max[2] * 2.55);
+    }
+
+    void apply(BarrierTapeDetection &btd) const
+    {
+        btd.updateDynamicVariables(false, min_area, thresh_min[0], thresh_min[1], thresh_min[2],
+                                   thresh_max[0], thresh_max[1], thresh_max[2]);
+    }
+};
+
+/**
+ * Maximum deviation of a detected box from its golden box
+ */
+const double GOLDEN_CENTER_TOLERANCE = 2.0;
+const double GOLDEN_AREA_TOLERANCE = 0.05;
+/**
+ * Maximum distance in pixels of a point of a detected contour from the outline of its
+ * golden contour and vice versa
+ */
+const double GOLDEN_POINT_TOLERANCE = 2.0;
+
+/**
+ * Noisy grey floor with a diagonal band of alternating yellow and black tape
+ */
+cv::Mat makeSyntheticFrame(const cv::Size &size)
+{
+    cv::Mat frame(size, CV_8UC3, cv::Scalar(110, 115, 120));
+    cv::Mat noise(size, CV_8UC3);
+    cv::randn(noise, cv::Scalar::all(0), cv::Scalar::all(12));
+    frame += noise;
+
+    int tape_width = size.height / 12;
+    int segment_length = size.width / 10;
+    for (int i = 0; i < 12; i++)
+    {
+        cv::Point start(i * segment_length, size.height / 2 + i * tape_width / 3);
+        cv::Point end((i + 1) * segment_length, size.height / 2 + (i + 1) * tape_width / 3);
+        cv::Scalar color = (i % 2 == 0) ? cv::Scalar(20, 220, 240) : cv::Scalar(25, 25, 25);
+        cv::line(frame, start, end, color, tape_width);
+    }
+    return frame;
+}
+
+/**
+ * Average wall clock time of func over num_iterations calls, in milliseconds
+ */
+template <typename Func>
+double timeIt(Func func, int num_iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_iterations; i++)
+    {
+        func();
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / num_iterations;
+}
+
+void benchmarkSegmentation(const std::string &name, const cv::Size &size, int num_iterations,
+                           const DetectionSettings &settings)
+{
+    const cv::Scalar COLOR_THRESH_MIN = settings.minScalar();
+    const cv::Scalar COLOR_THRESH_MAX = settings.maxScalar();
+
+    cv::Mat frame = makeSyntheticFrame(size);
+    cv::Mat hsv_img;
+    cv::Mat reference_mask;
+    cv::Mat fused_mask;
+    cv::Mat lut_mask;
+
+    ColorThresholdFilter filter;
+    filter.setThresholds(COLOR_THRESH_MIN, COLOR_THRESH_MAX);
+
+    double cvt_in_range_ms = timeIt([&]()
+    {
+        cv::cvtColor(frame, hsv_img, cv::COLOR_BGR2HSV);
+        cv::inRange(hsv_img, COLOR_THRESH_MIN, COLOR_THRESH_MAX, reference_mask);
+    }, num_iterations);
+
+    filter.setMethod(ColorThresholdFilter::FUSED_HSV);
+    double fused_ms = timeIt([&]() { filter.apply(frame, fused_mask); }, num_iterations);
+
+    // first call after a threshold change includes rebuilding the table
+    filter.setMethod(ColorThresholdFilter::LOOKUP_TABLE);
+    filter.setThresholds(COLOR_THRESH_MIN, COLOR_THRESH_MAX);
+    double lut_first_ms = timeIt([&]() { filter.apply(frame, lut_mask); }, 1);
+    double lut_ms = timeIt([&]() { filter.apply(frame, lut_mask); }, num_iterations);
+
+    double num_pixels = static_cast<double>(frame.total());
+    double fused_mismatch = cv::countNonZero(fused_mask != reference_mask) / num_pixels;
+    double lut_mismatch = cv::countNonZero(lut_mask != reference_mask) / num_pixels;
+
+    printf("%-6s %4dx%-4d  cvtColor+inRange %7.3f ms | fused %7.3f ms (mismatch %.4f%%) | "
+           "lookup table %7.3f ms, first frame %7.3f ms (mismatch %.4f%%)\n",
+           name.c_str(), size.width, size.height, cvt_in_range_ms, fused_ms, fused_mismatch * 100.0,
+           lut_ms, lut_first_ms, lut_mismatch * 100.0);
+}
+
+/**
+ * Average number of allocations per frame once the detector has warmed up
+ */
+template <typename Func>
+double countAllocations(Func func, int num_iterations)
+{
+    const int num_warmup_iterations = 5;
+    for (int i = 0; i < num_warmup_iterations; i++)
+    {
+        func();
+    }
+    size_t start = num_allocations;
+    for (int i = 0; i < num_iterations; i++)
+    {
+        func();
+    }
+    return static_cast<double>(num_allocations - start) / num_iterations;
+}
+
+void addStageTimings(const BarrierTapeStageTimings &timings, BarrierTapeStageTimings &total)
+{
+    total.downsampling += timings.downsampling;
+    total.segmentation += timings.segmentation;
+    total.blur += timings.blur;
+    total.edge_detection += timings.edge_detection;
+    total.contour_detection += timings.contour_detection;
+    total.box_fitting += timings.box_fitting;
+}
+
+void printStageTimings(const BarrierTapeStageTimings &total, int num_frames)
+{
+    printf("  downsampling %7.3f ms | segmentation %7.3f ms | blur %7.3f ms | canny %7.3f ms | contours %7.3f ms | "
+           "minAreaRect %7.3f ms\n",
+           total.downsampling / num_frames, total.segmentation / num_frames, total.blur / num_frames, total.edge_detection / num_frames,
+           total.contour_detection / num_frames, total.box_fitting / num_frames);
+}
+
+void benchmarkDetection(const std::string &name, const cv::Size &size, int num_iterations,
+                        const DetectionSettings &settings)
+{
+    cv::Mat frame = makeSyntheticFrame(size);
+    cv::Mat debug_img;
+
+    BarrierTapeDetection btd;
+    settings.apply(btd);
+
+    BarrierTapeContours barrier_tape_contours;
+    std::vector< std::vector<std::vector<int> > > barrier_tape_pts;
+
+    double flat_allocs = countAllocations([&]()
+    {
+        btd.detectBarrierTape(frame, debug_img, barrier_tape_contours);
+    }, num_iterations);
+    BarrierTapeStageTimings total_timings;
+    double flat_ms = timeIt([&]()
+    {
+        btd.detectBarrierTape(frame, debug_img, barrier_tape_contours);
+        addStageTimings(btd.getStageTimings(), total_timings);
+    }, num_iterations);
+
+    double nested_allocs = countAllocations([&]()
+    {
+        barrier_tape_pts.clear();
+        btd.detectBarrierTape(frame, debug_img, barrier_tape_pts);
+    }, num_iterations);
+    double nested_ms = timeIt([&]()
+    {
+        barrier_tape_pts.clear();
+        btd.detectBarrierTape(frame, debug_img, barrier_tape_pts);
+    }, num_iterations);
+
+    printf("%-6s %4dx%-4d  flat result %7.3f ms, %8.1f allocs/frame | nested vectors %7.3f ms, %8.1f allocs/frame "
+           "(%zu contours, %zu points)\n",
+           name.c_str(), size.width, size.height, flat_ms, flat_allocs, nested_ms, nested_allocs,
+           barrier_tape_contours.size(), barrier_tape_contours.points.size());
+    printStageTimings(total_timings, num_iterations);
+}
+
+/**
+ * Fraction of the reference contours whose box center lies inside one of the candidate boxes
+ */
+double computeRecall(const BarrierTapeContours &reference, const BarrierTapeContours &candidate)
+{
+    if (reference.empty())
+    {
+        return 1.0;
+    }
+
+    std::vector<cv::Point2f> corners(4);
+    size_t num_found = 0;
+    for (size_t i = 0; i < reference.size(); i++)
+    {
+        for (size_t j = 0; j < candidate.size(); j++)
+        {
+            candidate.boxes[j].points(corners.data());
+            if (cv::pointPolygonTest(corners, reference.boxes[i].center, false) >= 0)
+            {
+                num_found++;
+                break;
+            }
+        }
+    }
+    return static_cast<double>(num_found) / reference.size();
+}
+
+/**
+ * Detection time and recall of the downsampled detection scales relative to full resolution
+ */
+void benchmarkDetectionScales(const std::vector<cv::Mat> &frames, int num_iterations, const DetectionSettings &settings)
+{
+    const int scales[] = { 1, 2, 4 };
+
+    std::vector<BarrierTapeContours> reference(frames.size());
+    BarrierTapeContours barrier_tape_contours;
+    cv::Mat debug_img;
+
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++)
+    {
+        BarrierTapeDetection btd;
+        settings.apply(btd);
+        btd.setDetectionScale(scales[s]);
+
+        double recall = 0.0;
+        size_t num_contours = 0;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            BarrierTapeContours &result = (scales[s] == 1) ? reference[i] : barrier_tape_contours;
+            btd.detectBarrierTape(frames[i], debug_img, result);
+            recall += computeRecall(reference[i], result);
+            num_contours += result.size();
+        }
+
+        size_t frame_index = 0;
+        double ms = timeIt([&]()
+        {
+            btd.detectBarrierTape(frames[frame_index], debug_img, barrier_tape_contours);
+            frame_index = (frame_index + 1) % frames.size();
+        }, num_iterations);
+
+        printf("  scale 1/%d  %7.3f ms/frame, %6.1f contours/frame, recall %6.2f%%\n", scales[s], ms,
+               static_cast<double>(num_contours) / frames.size(), recall / frames.size() * 100.0);
+    }
+}
+
+/**
+ * Detection time of the extraction methods, and how many of the contours found by
+ * one method are also found by the other
+ */
+void benchmarkExtractionMethods(const std::vector<cv::Mat> &frames, int num_iterations,
+                                const DetectionSettings &settings)
+{
+    BarrierTapeDetection btd[2];
+    const char *names[] = { "canny contours", "connected components" };
+    const BarrierTapeDetection::ExtractionMethod methods[] = { BarrierTapeDetection::CANNY_CONTOURS,
+                                                               BarrierTapeDetection::CONNECTED_COMPONENTS };
+    BarrierTapeContours results[2];
+    BarrierTapeStageTimings total_timings[2];
+    double ms[2];
+    double recall[2] = { 0.0, 0.0 };
+    cv::Mat debug_img;
+
+    for (int m = 0; m < 2; m++)
+    {
+        settings.apply(btd[m]);
+        btd[m].setExtractionMethod(methods[m]);
+
+        size_t frame_index = 0;
+        ms[m] = timeIt([&]()
+        {
+            btd[m].detectBarrierTape(frames[frame_index], debug_img, results[m]);
+            addStageTimings(btd[m].getStageTimings(), total_timings[m]);
+            frame_index = (frame_index + 1) % frames.size();
+        }, num_iterations);
+    }
+
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        for (int m = 0; m < 2; m++)
+        {
+            btd[m].detectBarrierTape(frames[i], debug_img, results[m]);
+        }
+        recall[0] += computeRecall(results[1], results[0]);
+        recall[1] += computeRecall(results[0], results[1]);
+    }
+
+    for (int m = 0; m < 2; m++)
+    {
+        printf("  %-20s %7.3f ms/frame, finds %6.2f%% of the contours of %s\n", names[m], ms[m],
+               recall[m] / frames.size() * 100.0, names[1 - m]);
+        printStageTimings(total_timings[m], num_iterations);
+    }
+}
+
+/**
+ * Detecting several colour classes with one detector labels every pixel once, while
+ * one detector per class converts every pixel once per class
+ */
+void benchmarkColorClasses(const cv::Mat &frame, int num_iterations, const DetectionSettings &settings)
+{
+    // yellow, red with a hue range across 0 and white
+    std::vector<DetectionSettings> class_settings(3, settings);
+    const int red_min[3] = { 340, 50, 40 };
+    const int red_max[3] = { 20, 100, 100 };
+    const int white_min[3] = { 0, 0, 85 };
+    const int white_max[3] = { 360, 15, 100 };
+    std::copy(red_min, red_min + 3, class_settings[1].thresh_min);
+    std::copy(red_max, red_max + 3, class_settings[1].thresh_max);
+    std::copy(white_min, white_min + 3, class_settings[2].thresh_min);
+    std::copy(white_max, white_max + 3, class_settings[2].thresh_max);
+
+    std::vector<ColorClass> additional_classes;
+    for (size_t i = 1; i < class_settings.size(); i++)
+    {
+        additional_classes.push_back(ColorClass(class_settings[i].minScalar(), class_settings[i].maxScalar()));
+    }
+
+    cv::Mat debug_img;
+    BarrierTapeDetection multi_class_btd;
+    settings.apply(multi_class_btd);
+    multi_class_btd.setAdditionalColorClasses(additional_classes);
+    std::vector<BarrierTapeContours> class_contours;
+    double multi_class_ms = timeIt([&]()
+    {
+        multi_class_btd.detectBarrierTape(frame, debug_img, class_contours);
+    }, num_iterations);
+
+    std::vector<BarrierTapeDetection> single_class_btds(class_settings.size());
+    for (size_t i = 0; i < class_settings.size(); i++)
+    {
+        class_settings[i].apply(single_class_btds[i]);
+    }
+    BarrierTapeContours barrier_tape_contours;
+    double single_class_ms = timeIt([&]()
+    {
+        for (size_t i = 0; i < single_class_btds.size(); i++)
+        {
+            single_class_btds[i].detectBarrierTape(frame, debug_img, barrier_tape_contours);
+        }
+    }, num_iterations);
+
+    printf("  %zu classes: one detector %7.3f ms/frame | one detector per class %7.3f ms/frame\n",
+           class_settings.size(), multi_class_ms, single_class_ms);
+}
+
+std::string goldenFileName(const std::string &golden_dir, const std::string &frame_path)
+{
+    std::string frame_name = frame_path.substr(frame_path.find_last_of("/\\") + 1);
+    return golden_dir + "/" + frame_name.substr(0, frame_name.find_last_of('.')) + ".yml";
+}
+
+void writeGolden(const std::string &file_name, const BarrierTapeContours &barrier_tape_contours)
+{
+    cv::Mat boxes(static_cast<int>(barrier_tape_contours.size()), 5, CV_64F);
+    for (size_t i = 0; i < barrier_tape_contours.size(); i++)
+    {
+        const cv::RotatedRect &box = barrier_tape_contours.boxes[i];
+        double *row = boxes.ptr<double>(static_cast<int>(i));
+        row[0] = box.center.x;
+        row[1] = box.center.y;
+        row[2] = box.size.width;
+        row[3] = box.size.height;
+        row[4] = box.angle;
+    }
+
+    cv::FileStorage fs(file_name, cv::FileStorage::WRITE);
+    fs << "boxes" << boxes;
+    fs << "offsets" << barrier_tape_contours.offsets;
+    fs << "points" << barrier_tape_contours.points;
+}
+
+/**
+ * Largest distance of a point of one contour from the outline of the other one. The
+ * starting points of the contours are not compared, they depend on the scan order
+ */
+double computeContourDeviation(const std::vector<cv::Point> &contour_a, const std::vector<cv::Point> &contour_b)
+{
+    double deviation = 0.0;
+    for (size_t i = 0; i < contour_a.size(); i++)
+    {
+        deviation = std::max(deviation, std::abs(cv::pointPolygonTest(contour_b, contour_a[i], true)));
+    }
+    for (size_t i = 0; i < contour_b.size(); i++)
+    {
+        deviation = std::max(deviation, std::abs(cv::pointPolygonTest(contour_a, contour_b[i], true)));
+    }
+    return deviation;
+}
+
+/**
+ * Every golden contour has to be matched by exactly one detected contour with a box of
+ * similar center and area and with points close to the golden outline. The order of
+ * the contours is not compared, since it depends on the order in which the image is
+ * scanned.
+ */
+bool compareWithGolden(const std::string &file_name, const BarrierTapeContours &barrier_tape_contours,
+                       std::string &error)
+{
+    cv::FileStorage fs(file_name, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        error = "cannot open " + file_name;
+        return false;
+    }
+    cv::Mat boxes;
+    std::vector<int> offsets;
+    std::vector<cv::Point> points;
+    fs["boxes"] >> boxes;
+    fs["offsets"] >> offsets;
+    fs["points"] >> points;
+    if (offsets.size() != static_cast<size_t>(boxes.rows) + 1 || offsets.back() != static_cast<int>(points.size()))
+    {
+        error = "invalid contours in " + file_name;
+        return false;
+    }
+
+    if (boxes.rows != static_cast<int>(barrier_tape_contours.size()))
+    {
+        error = cv::format("%d golden contours, %zu detected", boxes.rows, barrier_tape_contours.size());
+        return false;
+    }
+
+    std::vector<bool> is_matched(barrier_tape_contours.size(), false);
+    for (int i = 0; i < boxes.rows; i++)
+    {
+        const double *row = boxes.ptr<double>(i);
+        cv::Point2d golden_center(row[0], row[1]);
+        double golden_area = row[2] * row[3];
+        std::vector<cv::Point> golden_contour(points.begin() + offsets[i], points.begin() + offsets[i + 1]);
+
+        bool found = false;
+        double min_deviation = -1.0;
+        for (size_t j = 0; j < barrier_tape_contours.size() && !found; j++)
+        {
+            const cv::RotatedRect &box = barrier_tape_contours.boxes[j];
+            double area = box.size.area();
+            if (is_matched[j] ||
+                cv::norm(cv::Point2d(box.center) - golden_center) > GOLDEN_CENTER_TOLERANCE ||
+                std::abs(area - golden_area) > GOLDEN_AREA_TOLERANCE * std::max(golden_area, 1.0))
+            {
+                continue;
+            }
+
+            std::vector<cv::Point> contour(barrier_tape_contours.contourBegin(j), barrier_tape_contours.contourEnd(j));
+            double deviation = computeContourDeviation(golden_contour, contour);
+            if (deviation <= GOLDEN_POINT_TOLERANCE)
+            {
+                is_matched[j] = true;
+                found = true;
+            }
+            else if (min_deviation < 0.0 || deviation < min_deviation)
+            {
+                min_deviation = deviation;
+            }
+        }
+        if (!found && min_deviation >= 0.0)
+        {
+            error = cv::format("golden contour at (%.1f, %.1f) detected with points %.1f pixels off",
+                               golden_center.x, golden_center.y, min_deviation);
+            return false;
+        }
+        if (!found)
+        {
+            error = cv::format("golden contour at (%.1f, %.1f) with area %.1f not detected",
+                               golden_center.x, golden_center.y, golden_area);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Runs the detector over all frames in frame_dir. Returns the number of frames whose
+ * detections do not match the golden contour sets in golden_dir
+ */
+int benchmarkRecordedFrames(const std::string &frame_dir, int num_iterations, const DetectionSettings &settings,
+                            const std::string &golden_dir, const std::string &write_golden_dir)
+{
+    std::vector<cv::String> frame_paths;
+    std::vector<cv::String> paths;
+    const char *patterns[] = { "*.png", "*.jpg", "*.jpeg", "*.bmp" };
+    for (size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+    {
+        cv::glob(frame_dir + "/" + patterns[i], paths, false);
+        frame_paths.insert(frame_paths.end(), paths.begin(), paths.end());
+    }
+    std::sort(frame_paths.begin(), frame_paths.end());
+    if (frame_paths.empty())
+    {
+        fprintf(stderr, "No frames found in %s\n", frame_dir.c_str());
+        return 1;
+    }
+
+    std::vector<cv::Mat> frames;
+    for (size_t i = 0; i < frame_paths.size(); i++)
+    {
+        frames.push_back(cv::imread(frame_paths[i], cv::IMREAD_COLOR));
+        if (frames.back().empty())
+        {
+            fprintf(stderr, "Cannot read %s\n", frame_paths[i].c_str());
+            return 1;
+        }
+    }
+
+    BarrierTapeDetection btd;
+    settings.apply(btd);
+    BarrierTapeContours barrier_tape_contours;
+    cv::Mat debug_img;
+
+    int num_mismatches = 0;
+    size_t total_contours = 0;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        btd.detectBarrierTape(frames[i], debug_img, barrier_tape_contours);
+        total_contours += barrier_tape_contours.size();
+        if (!write_golden_dir.empty())
+        {
+            writeGolden(goldenFileName(write_golden_dir, frame_paths[i]), barrier_tape_contours);
+        }
+        std::string error;
+        if (!golden_dir.empty() &&
+            !compareWithGolden(goldenFileName(golden_dir, frame_paths[i]), barrier_tape_contours, error))
+        {
+            printf("MISMATCH %s: %s\n", frame_paths[i].c_str(), error.c_str());
+            num_mismatches++;
+        }
+    }
+
+    BarrierTapeStageTimings total_timings;
+    int frame_index = 0;
+    double total_ms = timeIt([&]()
+    {
+        btd.detectBarrierTape(frames[frame_index], debug_img, barrier_tape_contours);
+        addStageTimings(btd.getStageTimings(), total_timings);
+        frame_index = (frame_index + 1) % frames.size();
+    }, num_iterations);
+
+    CountingMatAllocator counting_allocator;
+    cv::Mat::setDefaultAllocator(&counting_allocator);
+    frame_index = 0;
+    double allocs = countAllocations([&]()
+    {
+        btd.detectBarrierTape(frames[frame_index], debug_img, barrier_tape_contours);
+        frame_index = (frame_index + 1) % frames.size();
+    }, num_iterations);
+    cv::Mat::setDefaultAllocator(0);
+
+    printf("%zu frames from %s, %.1f contours/frame\n", frames.size(), frame_dir.c_str(),
+           static_cast<double>(total_contours) / frames.size());
+    printf("  total %7.3f ms/frame, %8.1f allocs/frame\n", total_ms, allocs);
+    printStageTimings(total_timings, num_iterations);
+    printf("Detection scales, recall relative to full resolution\n");
+    benchmarkDetectionScales(frames, num_iterations, settings);
+    printf("Extraction methods\n");
+    benchmarkExtractionMethods(frames, num_iterations, settings);
+    if (!write_golden_dir.empty())
+    {
+        printf("Golden contour sets written to %s\n", write_golden_dir.c_str());
+    }
+    if (!golden_dir.empty())
+    {
+        printf("%d of %zu frames differ from the golden contour sets in %s\n", num_mismatches, frames.size(),
+               golden_dir.c_str());
+    }
+    return num_mismatches;
+}
+
+void printUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--iterations N] [--frames DIR] [--thresholds H S V H S V] [--min-area A]\n"
+            "       [--write-golden DIR] [--golden DIR]\n", program);
+}
+}
+
+int main(int argc, char **argv)
+{
+    int num_iterations = 100;
+    DetectionSettings settings;
+    std::string frame_dir;
+    std::string golden_dir;
+    std::string write_golden_dir;
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--iterations") == 0 && has_value)
+        {
+            num_iterations = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && has_value)
+        {
+            frame_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--thresholds") == 0 && i + 6 < argc)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                settings.thresh_min[j] = atoi(argv[++i]);
+            }
+            for (int j = 0; j < 3; j++)
+            {
+                settings.thresh_max[j] = atoi(argv[++i]);
+            }
+        }
+        else if (strcmp(argv[i], "--min-area") == 0 && has_value)
+        {
+            settings.min_area = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--golden") == 0 && has_value)
+        {
+            golden_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--write-golden") == 0 && has_value)
+        {
+            write_golden_dir = argv[++i];
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!frame_dir.empty())
+    {
+        return benchmarkRecordedFrames(frame_dir, num_iterations, settings, golden_dir, write_golden_dir) > 0 ? 1 : 0;
+    }
+    if (!golden_dir.empty() || !write_golden_dir.empty())
+    {
+        fprintf(stderr, "Golden contour sets require --frames\n");
+        return 2;
+    }
+
+    printf("Colour segmentation, average over %d frames\n", num_iterations);
+    benchmarkSegmentation("VGA", cv::Size(640, 480), num_iterations, settings);
+    benchmarkSegmentation("1080p", cv::Size(1920, 1080), num_iterations, settings);
+
+    CountingMatAllocator counting_allocator;
+    cv::Mat::setDefaultAllocator(&counting_allocator);
+
+    printf("\nDetection, steady state allocations through operator new and cv::Mat.\n"
+           "Buffers opencv allocates internally with cv::fastMalloc (e.g. in Canny and findContours) are not counted\n");
+    benchmarkDetection("VGA", cv::Size(640, 480), num_iterations, settings);
+    benchmarkDetection("1080p", cv::Size(1920, 1080), num_iterations, settings);
+
+    cv::Mat::setDefaultAllocator(0);
+
+    printf("\nDetection scales at 1080p, recall relative to full resolution\n");
+    std::vector<cv::Mat> synthetic_frames(1, makeSyntheticFrame(cv::Size(1920, 1080)));
+    benchmarkDetectionScales(synthetic_frames, num_iterations, settings);
+
+    printf("\nExtraction methods at 1080p\n");
+    benchmarkExtractionMethods(synthetic_frames, num_iterations, settings);
+
+    printf("\nColour classes at 1080p\n");
+    benchmarkColorClasses(synthetic_frames[0], num_iterations, settings);
+
+    return 0;
+}
@@ -9,20 +9,75 @@
 #include <opencv2/opencv.hpp>
 #include <pcl_ros/point_cloud.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/transforms.h>
 #include <dynamic_reconfigure/server.h>
 #include <string>
+#include <vector>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <Eigen/Core>
 
 #include <message_filters/sync_policies/approximate_time.h>
 #include <message_filters/subscriber.h>
 #include <geometry_msgs/PoseArray.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <nav_msgs/Odometry.h>
+#include <std_msgs/Float64MultiArray.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <ros/callback_queue.h>
 #include <tf/transform_listener.h>
 
 #include <mir_barrier_tape_detection/BarrierTapeConfig.h>
 #include <mir_barrier_tape_detection/barrier_tape_detection.h>
+#include <mir_barrier_tape_detection/contour_sampler.h>
+#include <mir_barrier_tape_detection/ground_plane_projector.h>
+#include <mir_barrier_tape_detection/latest_mailbox.h>
+#include <mir_barrier_tape_detection/organized_cloud_accessor.h>
+#include <mir_barrier_tape_detection/temporal_fusion_grid.h>
+#include <mir_barrier_tape_detection/voxel_accumulator.h>
 
 typedef message_filters::sync_policies::ApproximateTime<sensor_msgs::PointCloud2, sensor_msgs::Image> ImageSyncPolicy;
 
+/**
+ * Synchronized pointcloud and RGB image of one camera frame
+ */
+struct BarrierTapeFrame
+{
+    sensor_msgs::PointCloud2::ConstPtr pointcloud_msg;
+    sensor_msgs::Image::ConstPtr rgb_image_msg;
+    ros::Time receive_time;
+};
+
+/**
+ * Everything published for one frame, together with the time it passed each stage
+ */
+struct BarrierTapeOutput
+{
+    /**
+     * One cloud per colour class
+     */
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> clouds;
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> delta_clouds;
+    /**
+     * Temporal fusion only publishes the clouds of classes which changed
+     */
+    std::vector<bool> is_cloud_updated;
+    /**
+     * Set if the frame was skipped because the base stands still, nothing is published then
+     */
+    bool is_skipped;
+    bool is_debug_mode;
+    cv::Mat debug_image;
+    geometry_msgs::PoseArray pose_array;
+
+    ros::Time camera_stamp;
+    ros::Time receive_time;
+    ros::Time processing_start_time;
+    ros::Time processing_end_time;
+};
+
 class BarrierTapeDetectionRos
 {
 
@@ -31,24 +86,79 @@ public:
     virtual ~BarrierTapeDetectionRos();
     void dynamicReconfigCallback(mir_barrier_tape_detection::BarrierTapeConfig &config, uint32_t level);
     void eventCallback(const std_msgs::String &event_command);
+    /**
+     * Grow the tracking regions according to the current velocity of the base
+     */
+    void odometryCallback(const nav_msgs::Odometry::ConstPtr &odometry_msg);
     /**
      * Get 3D pointcloud and RGB image at the same time
      */
     void synchronizedCallback(const sensor_msgs::PointCloud2::ConstPtr &pointcloud_msg, const sensor_msgs::Image::ConstPtr &rgb_image_msg);
+    /**
+     * Ground projection mode: the image is processed without a pointcloud
+     */
+    void imageCallback(const sensor_msgs::Image::ConstPtr &rgb_image_msg);
+    void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &camera_info_msg);
     void states();
     void initState();
     void idleState();
     void runState();
+    /**
+     * Detect barrier tape in the RGB image and map the contour pixels to 3D
+     * positions by reading them directly from the organized pointcloud
+     */
     void detectBarrierTape();
+
+private:
+    /**
+     * Read the additional colour classes from the color_classes parameter. Each entry has a
+     * name and min and max HSV thresholds in the units of BarrierTapeDetection.cfg
+     */
+    void loadColorClasses(ros::NodeHandle &nh);
+    /**
+     * Run the detection on one frame and fill output. If copy_results is set the
+     * output owns copies of the clouds and images, so it can be published by another
+     * thread while the next frame is processed
+     */
+    void processFrame(const BarrierTapeFrame &frame, bool copy_results, BarrierTapeOutput &output);
+    void publishOutput(const BarrierTapeOutput &output);
+    void resetBarrierTapePoints();
+    /**
+     * Pipelined mode: detection and publisher threads. The synchronized callback runs on
+     * its own AsyncSpinner and hands frames to the detection thread through frame_mailbox_
+     */
+    void startPipeline();
+    void stopPipeline();
+    void detectionThread();
+    void publisherThread();
+
+    /**
+     * Collect the 3D positions (in the camera frame) of the sampled contour pixels with valid
+     * depth of all colour classes, together with the index of the contour and class they belong to
+     */
+    void collectCandidatePoints(const cv::Mat &rgb_image_frame);
+    /**
+     * Look up the camera to target_frame_ transform once for the given header
+     */
+    bool lookupCameraTransform(const std_msgs::Header &header);
+    /**
+     * Apply the camera transform to all candidate points in a single matrix multiplication
+     */
+    void transformCandidatePoints();
+    /**
+     * Temporal fusion: apply the hits of this frame and misses in the view of the camera,
+     * and refresh the clouds of the classes whose occupied cells changed
+     */
+    void updateFusionGrids(const std_msgs::Header &header, bool has_depth_source);
+    /**
+     * True if the base stands still and none of the fusion grids changed recently
+     */
+    bool isStationary() const;
     /**
-     * Converts the input pointcloud message into a 3 channel cv::Mat object 
-     * where each channel holds the x, y and z coordinate of each pixel (i.e. the pixel
-     * corresponding to that point in the pointcloud. 
-     * Points which are NaN and the Z-coordinate is < 0.01 are discarded
-     *
-     * This output cv::Mat is later used to map pixels in the RGB image to 3D positions
+     * Set the pose of the camera in ground_frame_ for the given header, composed from the
+     * camera transform and the ground_frame_ to target_frame_ transform if they differ
      */
-    void convertPointCloudToXYZImage(cv::Mat &output_xyz_image);
+    bool updateGroundPlane(const std_msgs::Header &header);
 
 private:
     enum States
@@ -59,13 +169,22 @@ private:
     };
 
 private:
+    /**
+     * Private handle of the node or nodelet, declared before everything constructed from it
+     */
+    ros::NodeHandle node_handler_;
     dynamic_reconfigure::Server<mir_barrier_tape_detection::BarrierTapeConfig> dynamic_reconfigure_server_;
     ros::Time start_time_;
-    ros::NodeHandle node_handler_;
     ros::Publisher event_pub_;
-    ros::Publisher pub_yellow_barrier_tape_cloud_;
+    /**
+     * Cloud publishers per colour class, class 0 publishes on the yellow barrier tape topics
+     */
+    std::vector<ros::Publisher> class_cloud_pubs_;
+    std::vector<ros::Publisher> class_delta_cloud_pubs_;
     ros::Subscriber event_sub_;
+    ros::Subscriber odometry_sub_;
     ros::Subscriber pointcloud_sub_;
+    ros::Subscriber camera_info_sub_;
 
     message_filters::Subscriber<sensor_msgs::PointCloud2> sub_pointcloud_;
     message_filters::Subscriber<sensor_msgs::Image> sub_rgb_image_;
@@ -85,15 +204,109 @@ private:
     std_msgs::String event_out_msg_;
 
     BarrierTapeDetection btd_;
+    std::vector<std::string> class_names_;
+    std::vector<BarrierTapeContours> class_contours_;
+    OrganizedCloudAccessor cloud_accessor_;
+
+    /**
+     * Candidate points stored as consecutive x, y, z values in the camera frame
+     */
+    std::vector<float> candidate_xyz_;
+    std::vector<int> candidate_contour_ids_;
+    std::vector<int> candidate_class_ids_;
+    /**
+     * Pixels selected for the depth lookup, see sampling_policy in BarrierTapeDetection.cfg
+     */
+    ContourSampler contour_sampler_;
+    /**
+     * Ground projection mode: contour pixels are intersected with the z = 0 plane of
+     * ground_frame_ instead of being looked up in the pointcloud
+     */
+    bool use_ground_projection_;
+    std::string ground_frame_;
+    /**
+     * The image is rectified (e.g. image_rect_color), so its pixels are projected with the
+     * camera matrix in P of the camera info and without the distortion in D
+     */
+    bool rectified_input_;
+    GroundPlaneProjector ground_projector_;
+    std::vector<cv::Point> sample_pixels_;
+    std::vector<int> sample_contour_ids_;
+    std::vector<int> sample_class_ids_;
+    std::vector<int> valid_sample_indices_;
+    Eigen::Matrix3Xf transformed_candidates_;
+    /**
+     * Camera to target_frame_ transform of the current frame
+     */
+    Eigen::Matrix4f camera_transform_;
+    bool has_camera_transform_;
     States current_state_;
     cv::Mat debug_image_;
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr barrier_tape_cloud_;
+    /**
+     * Detected points of every colour class accumulated over time; barrier_tape_clouds_ hold
+     * the occupied voxels which are published every frame and barrier_tape_delta_clouds_
+     * the newly occupied ones
+     */
+    std::vector<boost::shared_ptr<VoxelAccumulator> > voxel_accumulators_;
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> barrier_tape_clouds_;
+    std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> barrier_tape_delta_clouds_;
+    bool publish_delta_;
+
+    /**
+     * Temporal fusion mode: detections are fused in a log-odds grid per colour class instead
+     * of being accumulated, see use_temporal_fusion in the README
+     */
+    bool use_temporal_fusion_;
+    std::vector<boost::shared_ptr<TemporalFusionGrid> > fusion_grids_;
+    std::vector<bool> is_cloud_updated_;
+    double fusion_half_view_angle_;
+    double fusion_view_range_;
+    /**
+     * While the base is slower than stationary_speed_ and the grids are stable, only every
+     * stationary_skip_frames_ frame is processed
+     */
+    double stationary_speed_;
+    int stationary_skip_frames_;
+    int num_skipped_frames_;
+    double base_speed_;
+
+    /**
+     * Guards the detector state against concurrent access from the dynamic reconfigure
+     * callback, event handling and the detection thread
+     */
+    std::mutex detector_mutex_;
+
+    bool use_pipeline_;
+    std::atomic<bool> is_pipeline_running_;
+    ros::CallbackQueue sensor_callback_queue_;
+    boost::shared_ptr<ros::AsyncSpinner> sensor_spinner_;
+    LatestMailbox<BarrierTapeFrame> frame_mailbox_;
+    LatestMailbox<BarrierTapeOutput> output_mailbox_;
+    std::thread detection_thread_;
+    std::thread publisher_thread_;
+    /**
+     * Publishes the acquisition, queueing, processing, publishing and end-to-end
+     * latency of every frame in milliseconds
+     */
+    ros::Publisher latency_pub_;
+    std_msgs::Float64MultiArray latency_msg_;
+    ros::Time receive_time_;
+    /**
+     * Pixels by which the tracking regions are grown per m/s (or rad/s) of base velocity
+     */
+    double roi_margin_per_velocity_;
 
     bool is_debug_mode_;
     bool has_image_data_;
     std::string target_frame_;
+    /**
+     * Maximum number of pixels tried per contour with the first_valid sampling policy
+     */
     int num_of_retrial_;
+    /**
+     * Distance in pixels between samples with the other sampling policies
+     */
     int num_pixels_to_extrapolate_;
 };
 
@@ -0,0 +1,92 @@
+#ifndef LATESTMAILBOX_H_
+#define LATESTMAILBOX_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+/**
+ * Single slot mailbox which only holds the most recent item.
+ *
+ * put() and take() are lock-free atomic exchanges on the slot. An item which is
+ * replaced before it was taken is dropped instead of queued, so a slow consumer
+ * always processes the latest data. The mutex is only used by consumers which
+ * want to sleep until an item arrives.
+ */
+template <typename T>
+class LatestMailbox
+{
+public:
+    LatestMailbox() : slot_(nullptr), num_dropped_(0)
+    {
+    }
+
+    virtual ~LatestMailbox()
+    {
+        delete slot_.exchange(nullptr);
+    }
+
+    void put(std::unique_ptr<T> item)
+    {
+        T *stale_item = slot_.exchange(item.release());
+        if (stale_item)
+        {
+            delete stale_item;
+            num_dropped_++;
+        }
+
+        {
+            // prevents the notification from getting lost between the predicate check and the wait
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+        }
+        wait_condition_.notify_one();
+    }
+
+    /**
+     * Returns the latest item, or an empty pointer if there is none
+     */
+    std::unique_ptr<T> take()
+    {
+        return std::unique_ptr<T>(slot_.exchange(nullptr));
+    }
+
+    /**
+     * Block until an item is available or the timeout expires.
+     * Returns true if an item is available
+     */
+    bool waitForItem(const std::chrono::milliseconds &timeout)
+    {
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        return wait_condition_.wait_for(lock, timeout, [this]() { return slot_.load() != nullptr; });
+    }
+
+    /**
+     * Wake up all consumers waiting in waitForItem(), e.g. on shutdown
+     */
+    void notifyAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+        }
+        wait_condition_.notify_all();
+    }
+
+    /**
+     * Number of items replaced before they were taken
+     */
+    size_t getNumDropped() const
+    {
+        return num_dropped_;
+    }
+
+private:
+    std::atomic<T *> slot_;
+    std::atomic<size_t> num_dropped_;
+
+    std::mutex wait_mutex_;
+    std::condition_variable wait_condition_;
+};
+
+#endif /* LATESTMAILBOX_H_ */
@@ -0,0 +1,61 @@
+#ifndef ORGANIZEDCLOUDACCESSOR_H_
+#define ORGANIZEDCLOUDACCESSOR_H_
+
+#include <sensor_msgs/PointCloud2.h>
+#include <pcl/point_types.h>
+#include <opencv2/core/core.hpp>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+/**
+ * Reads the XYZ coordinates of single pixels straight out of the data buffer of an
+ * organized sensor_msgs::PointCloud2, so only the queried points are ever touched
+ * and the cloud is neither converted nor copied
+ */
+class OrganizedCloudAccessor
+{
+public:
+    OrganizedCloudAccessor();
+    virtual ~OrganizedCloudAccessor();
+    /**
+     * Look up the offsets of the x, y and z fields. Returns false if the cloud is not
+     * organized, is big endian, its data is shorter than its size or it does not have
+     * FLOAT32 x, y and z fields within point_step
+     */
+    bool setInputCloud(const sensor_msgs::PointCloud2::ConstPtr &cloud);
+    /**
+     * Get the point corresponding to pixel (u, v).
+     * Returns false for pixels outside the cloud, NaN points and points whose
+     * Z-coordinate is < 0.01
+     */
+    inline bool getPoint(int u, int v, pcl::PointXYZ &point) const
+    {
+        if (!cloud_ || u < 0 || v < 0 || u >= static_cast<int>(cloud_->width) || v >= static_cast<int>(cloud_->height))
+        {
+            return false;
+        }
+
+        const uint8_t *data = &cloud_->data[v * cloud_->row_step + u * cloud_->point_step];
+        // the buffer gives no alignment guarantees for the fields
+        memcpy(&point.x, data + x_offset_, sizeof(float));
+        memcpy(&point.y, data + y_offset_, sizeof(float));
+        memcpy(&point.z, data + z_offset_, sizeof(float));
+
+        return !std::isnan(point.x) && !std::isnan(point.y) && !std::isnan(point.z) && point.z > 0.01;
+    }
+    /**
+     * Look up all pixels in one pass and append the valid points to xyz as consecutive
+     * x, y and z values. The index in pixels of every valid point is appended to valid_indices.
+     * Returns the number of valid points
+     */
+    size_t getPoints(const std::vector<cv::Point> &pixels, std::vector<float> &xyz, std::vector<int> &valid_indices) const;
+
+private:
+    sensor_msgs::PointCloud2::ConstPtr cloud_;
+    uint32_t x_offset_;
+    uint32_t y_offset_;
+    uint32_t z_offset_;
+};
+
+#endif /* ORGANIZEDCLOUDACCESSOR_H_ */
@@ -0,0 +1,22 @@
+#include <mir_barrier_tape_detection/barrier_tape_detection_ros.h>
+
+int main(int argc, char** argv)
+{
+    ros::init(argc, argv, "barrier_tape_detection");
+    ros::NodeHandle nh("~");
+    ROS_INFO("Barrier Tape Detection Node Initialised");
+    BarrierTapeDetectionRos btd(nh);
+
+    int loop_rate = 30;
+    nh.param<int>("loop_rate", loop_rate, 30);
+    ros::Rate rate(loop_rate);
+
+    while (ros::ok())
+    {
+        ros::spinOnce();
+        btd.states();
+        rate.sleep();
+    }
+
+    return 0;
+}
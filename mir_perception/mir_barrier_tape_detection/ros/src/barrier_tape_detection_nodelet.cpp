@@ -0,0 +1,42 @@
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+#include <boost/shared_ptr.hpp>
+
+#include <mir_barrier_tape_detection/barrier_tape_detection_ros.h>
+
+namespace mir_barrier_tape_detection
+{
+/**
+ * Runs BarrierTapeDetectionRos inside a nodelet manager. When loaded into the manager
+ * of the camera driver, images and pointclouds are passed by shared pointer instead
+ * of being serialised over TCPROS
+ */
+class BarrierTapeDetectionNodelet : public nodelet::Nodelet
+{
+public:
+    virtual void onInit()
+    {
+        ros::NodeHandle &nh = getPrivateNodeHandle();
+        btd_.reset(new BarrierTapeDetectionRos(nh));
+
+        int loop_rate = 30;
+        nh.param<int>("loop_rate", loop_rate, 30);
+        // the state machine is driven by a timer since a nodelet must not block in onInit
+        timer_ = nh.createTimer(ros::Duration(1.0 / loop_rate), &BarrierTapeDetectionNodelet::timerCallback, this);
+
+        NODELET_INFO("Barrier Tape Detection Nodelet Initialised");
+    }
+
+private:
+    void timerCallback(const ros::TimerEvent &event)
+    {
+        btd_->states();
+    }
+
+private:
+    boost::shared_ptr<BarrierTapeDetectionRos> btd_;
+    ros::Timer timer_;
+};
+}
+
+PLUGINLIB_EXPORT_CLASS(mir_barrier_tape_detection::BarrierTapeDetectionNodelet, nodelet::Nodelet)
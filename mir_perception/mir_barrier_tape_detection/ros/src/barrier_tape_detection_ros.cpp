@@ -1,38 +1,133 @@
 #include <mir_barrier_tape_detection/barrier_tape_detection_ros.h>
+#include <limits>
 
-BarrierTapeDetectionRos::BarrierTapeDetectionRos(ros::NodeHandle &nh) : node_handler_(nh), image_transporter_(nh)
+BarrierTapeDetectionRos::BarrierTapeDetectionRos(ros::NodeHandle &nh)
+    : node_handler_(nh), dynamic_reconfigure_server_(nh), image_transporter_(nh), is_pipeline_running_(false)
 {
-    transform_listener_ = new tf::TransformListener();
+    // in a nodelet "~" is the namespace of the manager, so nothing may use a default handle
+    transform_listener_ = new tf::TransformListener(nh);
 
     nh.param<std::string>("target_frame", target_frame_, "/base_link");
     nh.param<int>("num_of_retrial", num_of_retrial_, 30);
     nh.param<int>("num_pixels_to_extrapolate", num_pixels_to_extrapolate_, 30);
+    nh.param<bool>("use_pipeline", use_pipeline_, false);
+    nh.param<double>("roi_margin_per_velocity", roi_margin_per_velocity_, 40.0);
+    nh.param<bool>("use_ground_projection", use_ground_projection_, false);
+    nh.param<std::string>("ground_frame", ground_frame_, "/base_link");
+    nh.param<bool>("rectified_input", rectified_input_, false);
+    double max_ground_distance;
+    nh.param<double>("max_ground_distance", max_ground_distance, 5.0);
+    ground_projector_.setMaxDistance(max_ground_distance);
+
+    double voxel_size;
+    int max_voxels;
+    double voxel_decay_time;
+    int min_voxel_hits;
+    nh.param<double>("voxel_size", voxel_size, 0.02);
+    nh.param<int>("max_voxels", max_voxels, 20000);
+    nh.param<double>("voxel_decay_time", voxel_decay_time, 0.0);
+    nh.param<int>("min_voxel_hits", min_voxel_hits, 1);
+    nh.param<bool>("publish_delta", publish_delta_, false);
+
+    double fusion_cell_size;
+    double fusion_hit_log_odds;
+    double fusion_miss_log_odds;
+    double fusion_occupied_log_odds;
+    double fusion_max_log_odds;
+    double fusion_view_angle;
+    nh.param<bool>("use_temporal_fusion", use_temporal_fusion_, false);
+    nh.param<double>("fusion_cell_size", fusion_cell_size, 0.05);
+    nh.param<double>("fusion_hit_log_odds", fusion_hit_log_odds, 0.85);
+    nh.param<double>("fusion_miss_log_odds", fusion_miss_log_odds, -0.4);
+    nh.param<double>("fusion_occupied_log_odds", fusion_occupied_log_odds, 2.0);
+    nh.param<double>("fusion_max_log_odds", fusion_max_log_odds, 3.5);
+    nh.param<double>("fusion_view_angle", fusion_view_angle, 60.0);
+    nh.param<double>("fusion_view_range", fusion_view_range_, 3.0);
+    nh.param<double>("stationary_speed", stationary_speed_, 0.01);
+    nh.param<int>("stationary_skip_frames", stationary_skip_frames_, 10);
+    fusion_half_view_angle_ = 0.5 * fusion_view_angle * M_PI / 180.0;
+    base_speed_ = std::numeric_limits<double>::max();
+    num_skipped_frames_ = 0;
+
+    // class 0 is the yellow tape configured through dynamic reconfigure
+    class_names_.push_back("yellow");
+    loadColorClasses(nh);
     dynamic_reconfigure_server_.setCallback(boost::bind(&BarrierTapeDetectionRos::dynamicReconfigCallback, this, _1, _2));
 
     event_pub_ = node_handler_.advertise<std_msgs::String>("event_out", 1);
-    pub_yellow_barrier_tape_cloud_ = nh.advertise<pcl::PointCloud<pcl::PointXYZ> >("output/yellow_barrier_tape_pointcloud", 1);
+    for (size_t i = 0; i < class_names_.size(); i++)
+    {
+        std::string topic = "output/" + class_names_[i] + "_barrier_tape_pointcloud";
+        class_cloud_pubs_.push_back(nh.advertise<pcl::PointCloud<pcl::PointXYZ> >(topic, 1));
+        if (publish_delta_)
+        {
+            class_delta_cloud_pubs_.push_back(nh.advertise<pcl::PointCloud<pcl::PointXYZ> >(topic + "_delta", 1));
+        }
+
+        boost::shared_ptr<VoxelAccumulator> voxel_accumulator = boost::make_shared<VoxelAccumulator>();
+        voxel_accumulator->setParameters(voxel_size, max_voxels, voxel_decay_time, min_voxel_hits);
+        voxel_accumulator->setTrackNewlyOccupied(publish_delta_);
+        voxel_accumulators_.push_back(voxel_accumulator);
+        barrier_tape_clouds_.push_back(boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >());
+        barrier_tape_delta_clouds_.push_back(boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >());
+
+        boost::shared_ptr<TemporalFusionGrid> fusion_grid = boost::make_shared<TemporalFusionGrid>();
+        fusion_grid->setParameters(fusion_cell_size, fusion_hit_log_odds, fusion_miss_log_odds,
+                                   fusion_occupied_log_odds, fusion_max_log_odds);
+        fusion_grids_.push_back(fusion_grid);
+    }
+    is_cloud_updated_.resize(class_names_.size(), true);
     pub_yellow_barrier_tape_pose_array_ = nh.advertise<geometry_msgs::PoseArray>("output/yellow_barrier_tape_pose_array", 1);
     image_pub_ = image_transporter_.advertise("debug_image", 1);
+    latency_pub_ = nh.advertise<std_msgs::Float64MultiArray>("latency", 1);
 
-    event_sub_ = node_handler_.subscribe("event_in", 1, &BarrierTapeDetectionRos::eventCallback, this);
-    sub_pointcloud_.subscribe(node_handler_, "input_pointcloud", 1);
-    sub_rgb_image_.subscribe(node_handler_, "input_rgb_image", 1);
+    const char *latency_labels[] = {"acquisition", "queue", "processing", "publishing", "end_to_end"};
+    for (int i = 0; i < 5; i++)
+    {
+        std_msgs::MultiArrayDimension dim;
+        dim.label = latency_labels[i];
+        dim.size = 1;
+        dim.stride = 1;
+        latency_msg_.layout.dim.push_back(dim);
+    }
+    latency_msg_.data.resize(5, 0.0);
 
-    sub_pointcloud_.unsubscribe();
+    event_sub_ = node_handler_.subscribe("event_in", 1, &BarrierTapeDetectionRos::eventCallback, this);
+    odometry_sub_ = node_handler_.subscribe("input_odometry", 1, &BarrierTapeDetectionRos::odometryCallback, this);
+    // in pipelined mode the synchronized callback is served by its own spinner thread
+    ros::CallbackQueueInterface *sensor_queue = use_pipeline_ ? &sensor_callback_queue_ : NULL;
+    sub_rgb_image_.subscribe(node_handler_, "input_rgb_image", 1, ros::TransportHints(), sensor_queue);
     sub_rgb_image_.unsubscribe();
 
-    sync_input_ = boost::make_shared<message_filters::Synchronizer<ImageSyncPolicy> > (10);
-    sync_input_->connectInput(sub_pointcloud_, sub_rgb_image_);
-    sync_input_->registerCallback(boost::bind(&BarrierTapeDetectionRos::synchronizedCallback, this, _1, _2));
+    if (use_ground_projection_)
+    {
+        // the image alone is enough, points are computed from the camera model and TF
+        camera_info_sub_ = node_handler_.subscribe("camera_info", 1, &BarrierTapeDetectionRos::cameraInfoCallback, this);
+        sub_rgb_image_.registerCallback(boost::bind(&BarrierTapeDetectionRos::imageCallback, this, _1));
+    }
+    else
+    {
+        sub_pointcloud_.subscribe(node_handler_, "input_pointcloud", 1, ros::TransportHints(), sensor_queue);
+        sub_pointcloud_.unsubscribe();
+
+        sync_input_ = boost::make_shared<message_filters::Synchronizer<ImageSyncPolicy> > (10);
+        sync_input_->connectInput(sub_pointcloud_, sub_rgb_image_);
+        sync_input_->registerCallback(boost::bind(&BarrierTapeDetectionRos::synchronizedCallback, this, _1, _2));
+    }
 
     current_state_ = INIT;
     has_image_data_ = false;
 
-    barrier_tape_cloud_ = boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >();
+    if (use_pipeline_)
+    {
+        startPipeline();
+    }
 }
 
 BarrierTapeDetectionRos::~BarrierTapeDetectionRos()
 {
+    stopPipeline();
+    delete transform_listener_;
     image_pub_.shutdown();
     pub_yellow_barrier_tape_pose_array_.shutdown();
     event_pub_.shutdown();
@@ -40,17 +135,112 @@ BarrierTapeDetectionRos::~BarrierTapeDetectionRos()
 }
 
 
+void BarrierTapeDetectionRos::loadColorClasses(ros::NodeHandle &nh)
+{
+    XmlRpc::XmlRpcValue color_classes_param;
+    if (!nh.getParam("color_classes", color_classes_param))
+    {
+        return;
+    }
+    if (color_classes_param.getType() != XmlRpc::XmlRpcValue::TypeArray)
+    {
+        ROS_ERROR("color_classes has to be a list, ignoring it");
+        return;
+    }
+
+    std::vector<ColorClass> color_classes;
+    for (int i = 0; i < color_classes_param.size(); i++)
+    {
+        XmlRpc::XmlRpcValue &entry = color_classes_param[i];
+        if (entry.getType() != XmlRpc::XmlRpcValue::TypeStruct || !entry.hasMember("name") ||
+            !entry.hasMember("min") || !entry.hasMember("max") ||
+            entry["min"].getType() != XmlRpc::XmlRpcValue::TypeArray || entry["min"].size() != 3 ||
+            entry["max"].getType() != XmlRpc::XmlRpcValue::TypeArray || entry["max"].size() != 3)
+        {
+            ROS_ERROR("color_classes[%d] needs a name and min and max lists of H, S and V, ignoring it", i);
+            continue;
+        }
+
+        int thresh_min[3];
+        int thresh_max[3];
+        for (int j = 0; j < 3; j++)
+        {
+            thresh_min[j] = static_cast<int>(entry["min"][j]);
+            thresh_max[j] = static_cast<int>(entry["max"][j]);
+        }
+
+        // same conversion from the (360, 100, 100) range as for the dynamic reconfigure thresholds
+        color_classes.push_back(ColorClass(cv::Scalar(thresh_min[0] * 0.5, thresh_min[1] * 2.55, thresh_min[2] * 2.55),
+                                           cv::Scalar(thresh_max[0] * 0.5, thresh_max[1] * 2.55, thresh_max[2] * 2.55)));
+        class_names_.push_back(static_cast<std::string>(entry["name"]));
+    }
+    btd_.setAdditionalColorClasses(color_classes);
+}
+
 void BarrierTapeDetectionRos::dynamicReconfigCallback(mir_barrier_tape_detection::BarrierTapeConfig &config, uint32_t level)
 {
+    std::lock_guard<std::mutex> lock(detector_mutex_);
     is_debug_mode_ = config.is_debug_mode;
     btd_.updateDynamicVariables(is_debug_mode_, config.min_area, config.color_thresh_min_h, config.color_thresh_min_s,
                                 config.color_thresh_min_v, config.color_thresh_max_h, config.color_thresh_max_s, config.color_thresh_max_v);
+    btd_.setSegmentationMethod(config.segmentation_method);
+    btd_.setTrackingParameters(config.is_tracking_enabled, config.full_search_interval, config.roi_margin);
+    btd_.setDetectionScale(config.detection_scale);
+    btd_.setExtractionMethod(config.extraction_method);
+    contour_sampler_.setPolicy(static_cast<ContourSampler::Policy>(config.sampling_policy));
+    contour_sampler_.setParameters(num_pixels_to_extrapolate_, num_of_retrial_, config.point_budget);
+}
+
+void BarrierTapeDetectionRos::odometryCallback(const nav_msgs::Odometry::ConstPtr &odometry_msg)
+{
+    // the faster the base moves, the further the tape moves in the image between two frames
+    const geometry_msgs::Twist &twist = odometry_msg->twist.twist;
+    double speed = std::sqrt(twist.linear.x * twist.linear.x + twist.linear.y * twist.linear.y) + std::fabs(twist.angular.z);
+
+    std::lock_guard<std::mutex> lock(detector_mutex_);
+    btd_.setRoiMotionMargin(static_cast<int>(speed * roi_margin_per_velocity_));
+    base_speed_ = speed;
+}
+
+void BarrierTapeDetectionRos::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr &camera_info_msg)
+{
+    cv::Matx33d camera_matrix(camera_info_msg->K.data());
+    cv::Mat distortion_coefficients;
+    if (rectified_input_)
+    {
+        // a rectified image is undistorted already and projected with the left 3x3 of P
+        const boost::array<double, 12> &P = camera_info_msg->P;
+        camera_matrix = cv::Matx33d(P[0], P[1], P[2], P[4], P[5], P[6], P[8], P[9], P[10]);
+    }
+    else if (!camera_info_msg->D.empty())
+    {
+        distortion_coefficients = cv::Mat(camera_info_msg->D, true).reshape(1, 1);
+    }
+
+    std::lock_guard<std::mutex> lock(detector_mutex_);
+    ground_projector_.setCameraInfo(camera_matrix, distortion_coefficients);
+}
+
+void BarrierTapeDetectionRos::imageCallback(const sensor_msgs::Image::ConstPtr &rgb_image_msg)
+{
+    synchronizedCallback(sensor_msgs::PointCloud2::ConstPtr(), rgb_image_msg);
 }
 
 void BarrierTapeDetectionRos::synchronizedCallback(const sensor_msgs::PointCloud2::ConstPtr &pointcloud_msg, const sensor_msgs::Image::ConstPtr &rgb_image_msg)
 {
+    if (use_pipeline_)
+    {
+        std::unique_ptr<BarrierTapeFrame> frame(new BarrierTapeFrame);
+        frame->pointcloud_msg = pointcloud_msg;
+        frame->rgb_image_msg = rgb_image_msg;
+        frame->receive_time = ros::Time::now();
+        frame_mailbox_.put(std::move(frame));
+        return;
+    }
+
     pointcloud_msg_ = pointcloud_msg;
     rgb_image_msg_ = rgb_image_msg;
+    receive_time_ = ros::Time::now();
     has_image_data_ = true;
 }
 
@@ -83,7 +273,10 @@ void BarrierTapeDetectionRos::initState()
     {
         current_state_ = IDLE;
         event_in_msg_.data = "";
-        sub_pointcloud_.subscribe();
+        if (!use_ground_projection_)
+        {
+            sub_pointcloud_.subscribe();
+        }
         sub_rgb_image_.subscribe();
     }
     else
@@ -98,9 +291,17 @@ void BarrierTapeDetectionRos::idleState()
     {
         current_state_ = INIT;
         event_in_msg_.data = "";
-        sub_pointcloud_.unsubscribe();
+        if (!use_ground_projection_)
+        {
+            sub_pointcloud_.unsubscribe();
+        }
         sub_rgb_image_.unsubscribe();
     }
+    else if (event_in_msg_.data == "e_reset")
+    {
+        resetBarrierTapePoints();
+        event_in_msg_.data = "";
+    }
     else if (has_image_data_)
     {
         current_state_ = RUNNING;
@@ -116,158 +317,474 @@ void BarrierTapeDetectionRos::runState()
 {
     if (event_in_msg_.data == "e_reset")
     {
-        barrier_tape_cloud_->points.clear();
+        resetBarrierTapePoints();
         event_in_msg_.data = "";
     }
-    detectBarrierTape();
+
+    BarrierTapeFrame frame;
+    frame.pointcloud_msg = pointcloud_msg_;
+    frame.rgb_image_msg = rgb_image_msg_;
+    frame.receive_time = receive_time_;
+
+    BarrierTapeOutput output;
+    processFrame(frame, false, output);
+    publishOutput(output);
     current_state_ = IDLE;
+}
 
-    if (is_debug_mode_)
+void BarrierTapeDetectionRos::resetBarrierTapePoints()
+{
+    std::lock_guard<std::mutex> lock(detector_mutex_);
+    for (size_t i = 0; i < voxel_accumulators_.size(); i++)
+    {
+        voxel_accumulators_[i]->clear();
+        fusion_grids_[i]->clear();
+        barrier_tape_clouds_[i]->points.clear();
+        barrier_tape_clouds_[i]->width = 0;
+        // the cleared cloud has to be published even if the grid does not change
+        is_cloud_updated_[i] = true;
+    }
+    num_skipped_frames_ = 0;
+}
+
+void BarrierTapeDetectionRos::processFrame(const BarrierTapeFrame &frame, bool copy_results, BarrierTapeOutput &output)
+{
+    std::lock_guard<std::mutex> lock(detector_mutex_);
+
+    output.processing_start_time = ros::Time::now();
+    pointcloud_msg_ = frame.pointcloud_msg;
+    rgb_image_msg_ = frame.rgb_image_msg;
+
+    // while the base stands still and the fused grid has settled, most frames only confirm it
+    output.is_skipped = isStationary() && num_skipped_frames_ < stationary_skip_frames_;
+    if (output.is_skipped)
+    {
+        num_skipped_frames_++;
+        return;
+    }
+    num_skipped_frames_ = 0;
+
+    detectBarrierTape();
+
+    output.camera_stamp = frame.rgb_image_msg->header.stamp;
+    output.receive_time = frame.receive_time;
+    output.is_debug_mode = is_debug_mode_;
+    output.pose_array = pose_array_;
+    output.is_cloud_updated = is_cloud_updated_;
+
+    if (copy_results)
+    {
+        for (size_t i = 0; i < barrier_tape_clouds_.size(); i++)
+        {
+            output.clouds.push_back(boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >(*barrier_tape_clouds_[i]));
+            output.delta_clouds.push_back(boost::make_shared<pcl::PointCloud<pcl::PointXYZ> >(*barrier_tape_delta_clouds_[i]));
+        }
+        if (is_debug_mode_)
+        {
+            output.debug_image = debug_image_.clone();
+        }
+    }
+    else
+    {
+        output.clouds = barrier_tape_clouds_;
+        output.delta_clouds = barrier_tape_delta_clouds_;
+        output.debug_image = debug_image_;
+    }
+    output.processing_end_time = ros::Time::now();
+}
+
+void BarrierTapeDetectionRos::publishOutput(const BarrierTapeOutput &output)
+{
+    if (output.is_skipped)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < output.clouds.size(); i++)
+    {
+        if (output.is_cloud_updated[i])
+        {
+            class_cloud_pubs_[i].publish(output.clouds[i]);
+        }
+
+        if (publish_delta_ && !use_temporal_fusion_)
+        {
+            class_delta_cloud_pubs_[i].publish(output.delta_clouds[i]);
+        }
+    }
+
+    if (use_temporal_fusion_)
+    {
+        // the flags stay set until a published output carried them, since the
+        // pipeline may drop outputs before they are published
+        std::lock_guard<std::mutex> lock(detector_mutex_);
+        for (size_t i = 0; i < output.is_cloud_updated.size(); i++)
+        {
+            if (output.is_cloud_updated[i])
+            {
+                is_cloud_updated_[i] = false;
+            }
+        }
+    }
+
+    if (output.is_debug_mode)
     {
         cv_bridge::CvImage debug_image_msg;
         debug_image_msg.encoding = sensor_msgs::image_encodings::MONO8;
-        debug_image_msg.image = debug_image_;
+        debug_image_msg.image = output.debug_image;
         image_pub_.publish(debug_image_msg.toImageMsg());
 
-        pub_yellow_barrier_tape_pose_array_.publish(pose_array_);
+        pub_yellow_barrier_tape_pose_array_.publish(output.pose_array);
+    }
+
+    ros::Time publish_time = ros::Time::now();
+    latency_msg_.data[0] = (output.receive_time - output.camera_stamp).toSec() * 1000.0;
+    latency_msg_.data[1] = (output.processing_start_time - output.receive_time).toSec() * 1000.0;
+    latency_msg_.data[2] = (output.processing_end_time - output.processing_start_time).toSec() * 1000.0;
+    latency_msg_.data[3] = (publish_time - output.processing_end_time).toSec() * 1000.0;
+    latency_msg_.data[4] = (publish_time - output.camera_stamp).toSec() * 1000.0;
+    latency_pub_.publish(latency_msg_);
+}
+
+void BarrierTapeDetectionRos::startPipeline()
+{
+    is_pipeline_running_ = true;
+    detection_thread_ = std::thread(&BarrierTapeDetectionRos::detectionThread, this);
+    publisher_thread_ = std::thread(&BarrierTapeDetectionRos::publisherThread, this);
+
+    sensor_spinner_ = boost::make_shared<ros::AsyncSpinner>(1, &sensor_callback_queue_);
+    sensor_spinner_->start();
+}
+
+void BarrierTapeDetectionRos::stopPipeline()
+{
+    if (!is_pipeline_running_)
+    {
+        return;
+    }
+
+    sensor_spinner_->stop();
+    is_pipeline_running_ = false;
+    frame_mailbox_.notifyAll();
+    output_mailbox_.notifyAll();
+
+    if (detection_thread_.joinable())
+    {
+        detection_thread_.join();
+    }
+    if (publisher_thread_.joinable())
+    {
+        publisher_thread_.join();
+    }
+}
+
+void BarrierTapeDetectionRos::detectionThread()
+{
+    while (is_pipeline_running_)
+    {
+        if (!frame_mailbox_.waitForItem(std::chrono::milliseconds(100)))
+        {
+            continue;
+        }
+
+        std::unique_ptr<BarrierTapeFrame> frame = frame_mailbox_.take();
+        if (!frame)
+        {
+            continue;
+        }
+
+        std::unique_ptr<BarrierTapeOutput> output(new BarrierTapeOutput);
+        processFrame(*frame, true, *output);
+        // a skipped frame must not replace an output which was not published yet
+        if (!output->is_skipped)
+        {
+            output_mailbox_.put(std::move(output));
+        }
+
+        ROS_DEBUG_THROTTLE(5.0, "Dropped %zu stale frames and %zu stale outputs",
+                           frame_mailbox_.getNumDropped(), output_mailbox_.getNumDropped());
+    }
+}
+
+void BarrierTapeDetectionRos::publisherThread()
+{
+    while (is_pipeline_running_)
+    {
+        if (!output_mailbox_.waitForItem(std::chrono::milliseconds(100)))
+        {
+            continue;
+        }
+
+        std::unique_ptr<BarrierTapeOutput> output = output_mailbox_.take();
+        if (output)
+        {
+            publishOutput(*output);
+        }
     }
 }
 
 void BarrierTapeDetectionRos::detectBarrierTape()
 {
-    cv_bridge::CvImagePtr cv_img_tmp1 = cv_bridge::toCvCopy(rgb_image_msg_, sensor_msgs::image_encodings::BGR8);
-    cv::Mat rgb_image_frame = cv_img_tmp1->image;
+    // shares the message buffer if the image is already BGR8
+    cv_bridge::CvImageConstPtr cv_img_tmp1 = cv_bridge::toCvShare(rgb_image_msg_, sensor_msgs::image_encodings::BGR8);
+    const cv::Mat &rgb_image_frame = cv_img_tmp1->image;
 
-    barrier_tape_cloud_->header.frame_id = target_frame_;
-    pcl_conversions::toPCL(pointcloud_msg_->header.stamp, barrier_tape_cloud_->header.stamp);
+    // without a pointcloud the points are computed in the frame of the image
+    const std_msgs::Header &header = use_ground_projection_ ? rgb_image_msg_->header : pointcloud_msg_->header;
 
-    std::vector< std::vector<std::vector<int> > > barrier_tape_img_coordinates;
-    int pixel_y;
-    int pixel_x;
+    double stamp = header.stamp.toSec();
+    for (size_t c = 0; c < voxel_accumulators_.size(); c++)
+    {
+        barrier_tape_clouds_[c]->header.frame_id = target_frame_;
+        pcl_conversions::toPCL(header.stamp, barrier_tape_clouds_[c]->header.stamp);
+        voxel_accumulators_[c]->decay(stamp);
+    }
+
+    has_camera_transform_ = false;
 
     if (is_debug_mode_)
     {
         pose_array_.poses.clear();
-        pose_array_.header = pointcloud_msg_->header;
+        pose_array_.header = header;
         pose_array_.header.frame_id = target_frame_;
     }
 
-    cv::Mat rgb_depth_image_frame;
-    convertPointCloudToXYZImage(rgb_depth_image_frame);
+    bool has_depth_source = false;
+    if (use_ground_projection_)
+    {
+        has_depth_source = updateGroundPlane(header);
+    }
+    else
+    {
+        has_depth_source = cloud_accessor_.setInputCloud(pointcloud_msg_);
+        if (!has_depth_source)
+        {
+            ROS_WARN_THROTTLE(5.0, "Input pointcloud is not organized or has no x, y and z fields");
+        }
+    }
 
-    if (btd_.detectBarrierTape(rgb_image_frame, debug_image_, barrier_tape_img_coordinates))
+    if (has_depth_source && btd_.detectBarrierTape(rgb_image_frame, debug_image_, class_contours_))
     {
-        for (int i = 0; i < barrier_tape_img_coordinates.size(); i++)
+        collectCandidatePoints(rgb_image_frame);
+
+        if (!candidate_contour_ids_.empty() && (has_camera_transform_ || lookupCameraTransform(header)))
         {
-            for (int j = 0; j < barrier_tape_img_coordinates[i].size(); j++)
+            transformCandidatePoints();
+
+            // Ignore points which are > 0 since we are only interested in barrier tapes
+            // on the floor. Projected points are on the floor by construction
+            Eigen::Array<bool, 1, Eigen::Dynamic> is_on_floor = (transformed_candidates_.row(2).array() <= 0.0f);
+            if (use_ground_projection_)
             {
-                pixel_y = barrier_tape_img_coordinates[i][j][1];
-                pixel_x = barrier_tape_img_coordinates[i][j][0];
+                is_on_floor.setConstant(true);
+            }
 
-                cv::Vec3f point = rgb_depth_image_frame.at<cv::Vec3f>(pixel_y, pixel_x);
+            // with FIRST_VALID only the first candidate on the floor of every contour is kept
+            bool is_first_valid_only = (contour_sampler_.getPolicy() == ContourSampler::FIRST_VALID);
+            int last_added_contour = -1;
+            for (int i = 0; i < transformed_candidates_.cols(); i++)
+            {
+                if (is_debug_mode_)
+                {
+                    geometry_msgs::Pose pose;
+                    pose.position.x = transformed_candidates_(0, i);
+                    pose.position.y = transformed_candidates_(1, i);
+                    pose.position.z = transformed_candidates_(2, i);
+                    pose.orientation.z = 1;
+                    pose_array_.poses.push_back(pose);
+                }
 
-                if (point.val[0] == 0 && point.val[1] == 0 && point.val[2] == 0)
+                if (!is_on_floor(i) || (is_first_valid_only && candidate_contour_ids_[i] == last_added_contour))
                 {
                     continue;
                 }
 
+                pcl::PointXYZ point(transformed_candidates_(0, i), transformed_candidates_(1, i),
+                                    transformed_candidates_(2, i));
+                if (use_temporal_fusion_)
+                {
+                    fusion_grids_[candidate_class_ids_[i]]->addHit(point);
+                }
                 else
                 {
-                    geometry_msgs::PoseStamped pose_stamped;
-                    pose_stamped.pose.position.x = point.val[0];
-                    pose_stamped.pose.position.y = point.val[1];
-                    pose_stamped.pose.position.z = point.val[2];
-                    pose_stamped.pose.orientation.w = 0;
-                    pose_stamped.pose.orientation.x = 0;
-                    pose_stamped.pose.orientation.y = 0;
-                    pose_stamped.pose.orientation.z = 1;
-                    pose_stamped.header = pointcloud_msg_->header;
-
-                    geometry_msgs::PoseStamped transformed_pose;
-                    try {
-                        transform_listener_->waitForTransform(target_frame_, pose_stamped.header.frame_id, pose_stamped.header.stamp, ros::Duration(0.1));
-                        transform_listener_->transformPose(target_frame_, pose_stamped, transformed_pose);
-                        pose_array_.poses.push_back(transformed_pose.pose);
-
-                        // Ignore points which are > 0 since we are only interested in barrier tapes
-                        // on the floor
-                        if (transformed_pose.pose.position.z > 0.00)
-                        {
-                            ROS_DEBUG("transformed pose is greater than zero");
-                            continue;
-                        }
-
-                    } catch(tf::TransformException e) {
-                        ROS_WARN("%s", e.what());
-                    }
-
-                    pcl::PointXYZ pt;
-                    pt.x = transformed_pose.pose.position.x;
-                    pt.y = transformed_pose.pose.position.y;
-                    pt.z = transformed_pose.pose.position.z;
-
-                    barrier_tape_cloud_->points.push_back(pt);
-                    break;
+                    voxel_accumulators_[candidate_class_ids_[i]]->addPoint(point, stamp);
                 }
-
+                last_added_contour = candidate_contour_ids_[i];
             }
         }
     }
-    barrier_tape_cloud_->width = barrier_tape_cloud_->points.size();
-    barrier_tape_cloud_->height = 1;
+    if (use_temporal_fusion_)
+    {
+        updateFusionGrids(header, has_depth_source);
+        return;
+    }
 
-    pub_yellow_barrier_tape_cloud_.publish(barrier_tape_cloud_);
+    for (size_t c = 0; c < voxel_accumulators_.size(); c++)
+    {
+        voxel_accumulators_[c]->getOccupiedCloud(*barrier_tape_clouds_[c]);
+
+        if (publish_delta_)
+        {
+            barrier_tape_delta_clouds_[c]->header = barrier_tape_clouds_[c]->header;
+            voxel_accumulators_[c]->getNewlyOccupiedCloud(*barrier_tape_delta_clouds_[c]);
+        }
+    }
+}
+
+void BarrierTapeDetectionRos::collectCandidatePoints(const cv::Mat &rgb_image_frame)
+{
+    // box samples lie inside the tape area, contour samples found on a downsampled image
+    // are only refined to full resolution where they are sampled
+    bool is_refinement_needed = btd_.getDetectionScale() > 1 && contour_sampler_.getPolicy() != ContourSampler::BOX_FILL;
+
+    candidate_xyz_.clear();
+    candidate_contour_ids_.clear();
+    candidate_class_ids_.clear();
+
+    // one call for all classes, so the point budget applies to the whole frame;
+    // contour ids are unique across all classes
+    contour_sampler_.sample(class_contours_, sample_pixels_, sample_contour_ids_, sample_class_ids_);
+
+    if (is_refinement_needed)
+    {
+        for (size_t i = 0; i < sample_pixels_.size(); i++)
+        {
+            btd_.refinePoint(rgb_image_frame, sample_pixels_[i], sample_class_ids_[i]);
+        }
+    }
 
+    valid_sample_indices_.clear();
+    if (use_ground_projection_)
+    {
+        ground_projector_.projectPoints(sample_pixels_, candidate_xyz_, valid_sample_indices_);
+    }
+    else
+    {
+        cloud_accessor_.getPoints(sample_pixels_, candidate_xyz_, valid_sample_indices_);
+    }
+    for (size_t i = 0; i < valid_sample_indices_.size(); i++)
+    {
+        candidate_contour_ids_.push_back(sample_contour_ids_[valid_sample_indices_[i]]);
+        candidate_class_ids_.push_back(sample_class_ids_[valid_sample_indices_[i]]);
+    }
 }
 
-void BarrierTapeDetectionRos::convertPointCloudToXYZImage(cv::Mat &output_xyz_image)
+bool BarrierTapeDetectionRos::updateGroundPlane(const std_msgs::Header &header)
 {
-    pcl::PCLPointCloud2::Ptr pcl_input_cloud(new pcl::PCLPointCloud2);
+    if (!ground_projector_.hasCameraInfo())
+    {
+        ROS_WARN_THROTTLE(5.0, "Waiting for camera_info to project barrier tape onto the ground");
+        return false;
+    }
 
-    pcl_conversions::toPCL(*pointcloud_msg_, *pcl_input_cloud);
+    // the camera to target_frame_ transform is needed for the detected points anyway,
+    // so it is the only transform waited for in this frame
+    if (!lookupCameraTransform(header))
+    {
+        return false;
+    }
+
+    Eigen::Matrix4f camera_to_ground = camera_transform_;
+    if (ground_frame_ != target_frame_)
+    {
+        tf::StampedTransform transform;
+        try
+        {
+            // the robot frames are up to date at this stamp after waiting for the camera transform
+            transform_listener_->lookupTransform(ground_frame_, target_frame_, header.stamp, transform);
+        }
+        catch (tf::TransformException &e)
+        {
+            ROS_WARN("%s", e.what());
+            return false;
+        }
+        Eigen::Matrix4f target_to_ground;
+        pcl_ros::transformAsMatrix(transform, target_to_ground);
+        camera_to_ground = target_to_ground * camera_transform_;
+    }
 
-    pcl::PointCloud<pcl::PointXYZ>::Ptr xyz_input_cloud(new pcl::PointCloud<pcl::PointXYZ>);
-    pcl::fromPCLPointCloud2(*pcl_input_cloud, *xyz_input_cloud);
+    cv::Matx33d rotation;
+    cv::Vec3d translation;
+    for (int row = 0; row < 3; row++)
+    {
+        for (int column = 0; column < 3; column++)
+        {
+            rotation(row, column) = camera_to_ground(row, column);
+        }
+        translation[row] = camera_to_ground(row, 3);
+    }
+    ground_projector_.setCameraPose(rotation, translation);
+    return true;
+}
 
-    pcl::PointCloud<pcl::PointXYZ>::iterator b1;
+void BarrierTapeDetectionRos::updateFusionGrids(const std_msgs::Header &header, bool has_depth_source)
+{
+    // misses are only applied if it is known which part of the floor the camera saw
+    bool has_view = has_depth_source && (has_camera_transform_ || lookupCameraTransform(header));
 
-    int index = 0;
-    float * xyz_frame_buffer = new float[pointcloud_msg_->width * pointcloud_msg_->height  * 3];
-    cv::Mat xyz_frame(pointcloud_msg_->height, pointcloud_msg_->width, CV_32FC3, xyz_frame_buffer);
-    xyz_frame = cv::Scalar::all(0.0f);
-    for (b1 = xyz_input_cloud->points.begin(); b1 < xyz_input_cloud->points.end(); b1++)
+    for (size_t c = 0; c < fusion_grids_.size(); c++)
     {
+        TemporalFusionGrid &fusion_grid = *fusion_grids_[c];
+        if (has_view)
+        {
+            // the optical axis of the camera is its z axis
+            fusion_grid.setView(camera_transform_(0, 3), camera_transform_(1, 3), camera_transform_(0, 2),
+                                camera_transform_(1, 2), fusion_half_view_angle_, fusion_view_range_);
+        }
+        else
+        {
+            fusion_grid.setView(0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+        }
 
-        pcl::PointXYZ pcl_point = *b1;
-        if ((!pcl_isnan(pcl_point.x)) && (!pcl_isnan(pcl_point.y)) && (!pcl_isnan(pcl_point.z) && (pcl_point.z >0.01)))
+        bool has_changed = fusion_grid.update();
+        if (has_changed)
         {
-            xyz_frame_buffer[index * 3] = b1->x;
-            xyz_frame_buffer[index * 3 + 1] = b1->y;
-            xyz_frame_buffer[index * 3 + 2] = b1->z;
+            fusion_grid.getOccupiedCloud(*barrier_tape_clouds_[c]);
         }
-        index++;
+        // keep a pending update after a reset until it was published
+        is_cloud_updated_[c] = has_changed || is_cloud_updated_[c];
     }
-    xyz_frame.copyTo(output_xyz_image);
-    delete xyz_frame_buffer;
 }
 
-int main(int argc, char** argv)
+bool BarrierTapeDetectionRos::isStationary() const
 {
-    ros::init(argc, argv, "barrier_tape_detection");
-    ros::NodeHandle nh("~");
-    ROS_INFO("Barrier Tape Detection Node Initialised");
-    BarrierTapeDetectionRos btd(nh);
+    if (!use_temporal_fusion_ || base_speed_ > stationary_speed_)
+    {
+        return false;
+    }
 
-    int loop_rate = 30;
-    nh.param<int>("loop_rate", loop_rate, 30);
-    ros::Rate rate(loop_rate);
+    for (size_t c = 0; c < fusion_grids_.size(); c++)
+    {
+        if (fusion_grids_[c]->getNumStableFrames() < stationary_skip_frames_)
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-    while (ros::ok())
+bool BarrierTapeDetectionRos::lookupCameraTransform(const std_msgs::Header &header)
+{
+    tf::StampedTransform transform;
+    try
+    {
+        transform_listener_->waitForTransform(target_frame_, header.frame_id, header.stamp, ros::Duration(0.1));
+        transform_listener_->lookupTransform(target_frame_, header.frame_id, header.stamp, transform);
+    }
+    catch (tf::TransformException &e)
     {
-        ros::spinOnce();
-        btd.states();
-        rate.sleep();
+        ROS_WARN("%s", e.what());
+        return false;
     }
 
-    return 0;
+    pcl_ros::transformAsMatrix(transform, camera_transform_);
+    has_camera_transform_ = true;
+    return true;
+}
+
+void BarrierTapeDetectionRos::transformCandidatePoints()
+{
+    Eigen::Map<const Eigen::Matrix3Xf> candidates(candidate_xyz_.data(), 3, candidate_contour_ids_.size());
+    transformed_candidates_ = (camera_transform_.topLeftCorner<3, 3>() * candidates).colwise()
+                              + camera_transform_.topRightCorner<3, 1>();
 }
@@ -0,0 +1,99 @@
+#include <mir_barrier_tape_detection/organized_cloud_accessor.h>
+
+OrganizedCloudAccessor::OrganizedCloudAccessor() : x_offset_(0), y_offset_(0), z_offset_(0)
+{
+}
+
+OrganizedCloudAccessor::~OrganizedCloudAccessor()
+{
+}
+
+bool OrganizedCloudAccessor::setInputCloud(const sensor_msgs::PointCloud2::ConstPtr &cloud)
+{
+    cloud_.reset();
+
+    // points are read straight from the buffer, so it has to hold every row of the cloud
+    if (!cloud || cloud->height <= 1 || cloud->is_bigendian ||
+        cloud->row_step < static_cast<size_t>(cloud->width) * cloud->point_step ||
+        cloud->data.size() < static_cast<size_t>(cloud->row_step) * cloud->height)
+    {
+        return false;
+    }
+
+    int num_found_fields = 0;
+    for (size_t i = 0; i < cloud->fields.size(); i++)
+    {
+        const sensor_msgs::PointField &field = cloud->fields[i];
+        if (field.datatype != sensor_msgs::PointField::FLOAT32 || field.offset + sizeof(float) > cloud->point_step)
+        {
+            continue;
+        }
+
+        if (field.name == "x")
+        {
+            x_offset_ = field.offset;
+            num_found_fields++;
+        }
+        else if (field.name == "y")
+        {
+            y_offset_ = field.offset;
+            num_found_fields++;
+        }
+        else if (field.name == "z")
+        {
+            z_offset_ = field.offset;
+            num_found_fields++;
+        }
+    }
+
+    if (num_found_fields != 3)
+    {
+        return false;
+    }
+
+    cloud_ = cloud;
+    return true;
+}
+
+size_t OrganizedCloudAccessor::getPoints(const std::vector<cv::Point> &pixels, std::vector<float> &xyz,
+                                         std::vector<int> &valid_indices) const
+{
+    if (!cloud_)
+    {
+        return 0;
+    }
+
+    const int width = static_cast<int>(cloud_->width);
+    const int height = static_cast<int>(cloud_->height);
+    const uint32_t row_step = cloud_->row_step;
+    const uint32_t point_step = cloud_->point_step;
+    const uint8_t *data = cloud_->data.data();
+
+    size_t num_valid = 0;
+    xyz.reserve(xyz.size() + 3 * pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        const cv::Point &pixel = pixels[i];
+        if (pixel.x < 0 || pixel.y < 0 || pixel.x >= width || pixel.y >= height)
+        {
+            continue;
+        }
+
+        const uint8_t *point_data = data + pixel.y * row_step + pixel.x * point_step;
+        float x, y, z;
+        memcpy(&x, point_data + x_offset_, sizeof(float));
+        memcpy(&y, point_data + y_offset_, sizeof(float));
+        memcpy(&z, point_data + z_offset_, sizeof(float));
+        if (std::isnan(x) || std::isnan(y) || std::isnan(z) || z <= 0.01)
+        {
+            continue;
+        }
+
+        xyz.push_back(x);
+        xyz.push_back(y);
+        xyz.push_back(z);
+        valid_indices.push_back(static_cast<int>(i));
+        num_valid++;
+    }
+    return num_valid;
+}
@@ -0,0 +1,93 @@
+#ifndef CROP_VOXEL_FILTER_H
+#define CROP_VOXEL_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Geometry>
+
+/**
+ * Fused replacement of transforming a cloud, cropping it with passthrough filters on
+ * y and z and downsampling it with a voxel grid.
+ *
+ * The xyz fields are read directly from a raw point buffer (e.g. the data of a
+ * sensor_msgs/PointCloud2), so the full cloud is only read once and never copied.
+ * Points are transformed and cropped in blocks in structure-of-arrays form, which
+ * the compiler vectorises, and the points inside the box are added straight to a
+ * voxel hash. Both the cropped points and the voxel centroids are returned, since
+ * the handle detection needs the dense cloud for the prism extraction.
+ */
+class CropVoxelFilter
+{
+    public:
+        CropVoxelFilter();
+        virtual ~CropVoxelFilter();
+
+        /**
+         * Transform from the frame of the input points to the frame of the crop box and output
+         */
+        void setTransform(const Eigen::Affine3f &transform);
+        /**
+         * Limits (inclusive) of the crop box in the output frame, x is not limited
+         */
+        void setCropBox(float y_min, float y_max, float z_min, float z_max);
+        void setLeafSize(float leaf_size_x, float leaf_size_y, float leaf_size_z);
+
+        /**
+         * Process num_points points of point_step bytes each, whose x, y and z are
+         * consecutive floats starting at xyz_offset bytes into every point.
+         * cropped receives the transformed points inside the crop box and voxelized
+         * the centroid of the points of every occupied voxel. Points with NaN
+         * coordinates are dropped
+         */
+        void filter(const uint8_t *data, size_t num_points, size_t point_step, size_t xyz_offset,
+                    pcl::PointCloud<pcl::PointXYZ> &cropped, pcl::PointCloud<pcl::PointXYZ> &voxelized);
+        /**
+         * Index in the input of every cropped point of the last call to filter, which is
+         * its pixel index for an organized cloud
+         */
+        const std::vector<int> &getCroppedIndices() const;
+
+    private:
+        struct Voxel
+        {
+            float sum_x;
+            float sum_y;
+            float sum_z;
+            int num_points;
+        };
+
+        uint64_t computeKey(float x, float y, float z) const;
+        /**
+         * Index in voxels of the voxel with the given key, which is added empty if it
+         * is not in the hash yet
+         */
+        int getVoxelIndex(uint64_t key);
+        /**
+         * Double the capacity of the voxel hash and insert its keys again
+         */
+        void growVoxelHash();
+
+        Eigen::Affine3f transform;
+        float y_min;
+        float y_max;
+        float z_min;
+        float z_max;
+        Eigen::Array3f inverse_leaf_size;
+
+        /**
+         * Voxel hash with open addressing and linear probing, maps the voxel key in
+         * every slot of voxel_keys to its index in voxels. The slots are only emptied
+         * between calls, so after the first frames filtering does not allocate
+         */
+        std::vector<uint64_t> voxel_keys;
+        std::vector<int> voxel_indices;
+        int voxel_hash_bits;
+        std::vector<Voxel> voxels;
+        std::vector<int> cropped_indices;
+};
+#endif
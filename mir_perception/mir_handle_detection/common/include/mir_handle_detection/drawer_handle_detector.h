@@ -0,0 +1,77 @@
+#ifndef DRAWER_HANDLE_DETECTOR_H
+#define DRAWER_HANDLE_DETECTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include <yaml-cpp/yaml.h>
+
+#include <mir_handle_detection/perception_pipeline.h>
+
+/**
+ * Finds the drawer handle with a PerceptionPipeline, by default (ros/config/drawer_handle_pipeline.yaml)
+ * by fitting a bar to the points in front of the drawer plane, or as the closest cluster of them.
+ *
+ * All intermediate clouds, indices and the KD-tree are owned by the pipeline and reused
+ * for every frame. Their buffers keep their capacity, so once the detector has seen a
+ * cloud of a given size, later frames of up to that size do not allocate point buffers.
+ */
+class DrawerHandleDetector
+{
+    public:
+        DrawerHandleDetector();
+        virtual ~DrawerHandleDetector();
+
+        /**
+         * Build the pipeline from config. Besides the stages, config names the pose buffer
+         * holding the handle (handle_pose, default handle_pose) and the cloud returned by
+         * getSegmentedCloud (segmented_cloud, default segmented), and whether the stage writing
+         * the pose estimates its orientation (handle_orientation, default false). Throws
+         * std::invalid_argument or YAML::Exception for an invalid configuration
+         */
+        void configure(const YAML::Node &config);
+        void configureFromFile(const std::string &filename);
+
+        /**
+         * Detect the handle in a raw point buffer of width * height points as described in
+         * CropVoxelFilter::filter, whose points are moved into the output frame by transform.
+         * height is 1 for an unorganized cloud. Returns false if no handle was found
+         */
+        bool detect(const uint8_t *data, int width, int height, size_t point_step, size_t xyz_offset,
+                    const Eigen::Affine3f &transform, Eigen::Affine3f &handle_pose);
+        /**
+         * Detect the handle in a cloud, e.g. loaded from a PCD file
+         */
+        bool detect(const PCloudT &cloud, const Eigen::Affine3f &transform, Eigen::Affine3f &handle_pose);
+        /**
+         * False if the rotation of the detected pose is always the identity
+         */
+        bool hasOrientation() const;
+        /**
+         * Points in front of the drawer plane found by the last call to detect
+         */
+        PCloudT::ConstPtr getSegmentedCloud() const;
+        /**
+         * Duration of every stage of the last call to detect
+         */
+        const std::vector<PerceptionPipeline::StageTiming> &getTimings() const;
+        /**
+         * Duration of the last call to detect
+         */
+        double getMilliseconds() const;
+        /**
+         * Forget the drawer plane of the previous frame, which otherwise seeds the plane fit
+         */
+        void reset();
+
+    private:
+        PerceptionPipeline pipeline;
+        Eigen::Affine3f *handle_pose;
+        bool has_orientation;
+        PCloudT::Ptr segmented_cloud;
+};
+#endif
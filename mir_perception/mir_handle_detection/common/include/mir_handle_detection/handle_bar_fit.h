@@ -0,0 +1,80 @@
+#ifndef HANDLE_BAR_FIT_H
+#define HANDLE_BAR_FIT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+
+#include <Eigen/Geometry>
+
+/**
+ * Fits a straight bar handle parallel to the drawer front to the points in front of it,
+ * instead of clustering them.
+ *
+ * A hypothesis is the line through two sampled points, lines which are not parallel to the
+ * drawer front within eps_angle are rejected and points within distance_threshold of the
+ * line are its inliers. The number of iterations adapts to the best inlier ratio as in
+ * PlaneRansac. The axis of the best line is refined with a PCA of its inliers. The bar is
+ * accepted if its length along the axis and its radius are within the limits, the radius
+ * being estimated from the spread of the inliers across the axis on the drawer front, which
+ * holds for round and for flat bars.
+ */
+class HandleBarFit
+{
+    public:
+        HandleBarFit();
+        virtual ~HandleBarFit();
+
+        void setDistanceThreshold(float distance_threshold);
+        /**
+         * Maximum angle (radians) between the bar and the drawer front
+         */
+        void setEpsAngle(float eps_angle);
+        void setMaxIterations(int max_iterations, double probability);
+        void setMinInliers(int min_inliers);
+        /**
+         * Points within distance_threshold of a line are spread across a band at most that wide,
+         * so radius_max has to be below distance_threshold to reject wide surfaces
+         */
+        void setRadiusLimits(float radius_min, float radius_max);
+        void setLengthLimits(float length_min, float length_max);
+
+        /**
+         * Fit the bar to cloud, plane holds a, b, c, d of the drawer front ax + by + cz + d = 0.
+         * The pose is at the middle of the visible part of the bar, its x axis is the normal of
+         * the drawer front pointing away from the origin, its y axis is along the bar and points
+         * to the positive side of the largest component. Returns false if no bar was found
+         */
+        bool fit(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector4f &plane, Eigen::Affine3f &pose);
+        /**
+         * Indices of the points of the bar found by the last call to fit
+         */
+        const std::vector<int> &getInliers() const;
+
+    private:
+        /**
+         * Number of points within distance_threshold of the line, or a number <= count_to_beat
+         * once it can no longer exceed it
+         */
+        int countInliers(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector3f &point,
+                         const Eigen::Vector3f &direction, int count_to_beat) const;
+        void collectInliers(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector3f &point,
+                            const Eigen::Vector3f &direction);
+        int computeRequiredIterations(int inlier_count, size_t num_points) const;
+
+        float distance_threshold;
+        float eps_angle;
+        int max_iterations;
+        double probability;
+        int min_inliers;
+        float radius_min;
+        float radius_max;
+        float length_min;
+        float length_max;
+
+        uint32_t num_calls;
+        std::vector<int> inliers;
+};
+#endif
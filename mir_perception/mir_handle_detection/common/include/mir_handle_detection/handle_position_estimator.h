@@ -0,0 +1,66 @@
+#ifndef HANDLE_POSITION_ESTIMATOR_H
+#define HANDLE_POSITION_ESTIMATOR_H
+
+#include <deque>
+#include <vector>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include <Eigen/StdDeque>
+
+/**
+ * Fuses the handle positions detected in consecutive frames.
+ *
+ * The last window_size detections are kept. Detections further than outlier_distance
+ * from their component-wise median are rejected, and the estimate is the mean of the
+ * remaining ones. It has converged once at least min_inliers detections agree and
+ * their standard deviation along every direction is below convergence_stddev. The
+ * orientation is the normalised mean of the quaternions of the same detections.
+ */
+class HandlePositionEstimator
+{
+    public:
+        HandlePositionEstimator();
+        virtual ~HandlePositionEstimator();
+
+        void setParameters(int window_size, int min_inliers, float outlier_distance, float convergence_stddev);
+        void reset();
+        void addDetection(const Eigen::Vector3f &position, const Eigen::Quaternionf &orientation);
+        bool isConverged() const;
+        int getNumDetections() const;
+        /**
+         * Mean of the inlier detections and the covariance of that mean.
+         * Returns false if there are no detections
+         */
+        bool getEstimate(Eigen::Vector3f &position, Eigen::Matrix3f &covariance) const;
+        /**
+         * Mean orientation of the inlier detections and the variance of its angle in radians².
+         * Returns false if there are no detections
+         */
+        bool getOrientation(Eigen::Quaternionf &orientation, float &variance) const;
+
+    private:
+        void update();
+        void updateOrientation();
+
+        int window_size;
+        int min_inliers;
+        float outlier_distance;
+        float convergence_stddev;
+
+        std::deque<Eigen::Vector3f> detections;
+        std::deque<Eigen::Quaternionf, Eigen::aligned_allocator<Eigen::Quaternionf> > orientations;
+        Eigen::Vector3f position;
+        Eigen::Matrix3f covariance;
+        Eigen::Quaternionf orientation;
+        float orientation_variance;
+        int num_inliers;
+        bool is_converged;
+
+        /**
+         * Buffer reused for the medians
+         */
+        std::vector<float> values;
+        std::vector<char> is_inlier;
+};
+#endif
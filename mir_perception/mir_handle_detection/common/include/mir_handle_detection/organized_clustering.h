@@ -0,0 +1,59 @@
+#ifndef ORGANIZED_CLUSTERING_H
+#define ORGANIZED_CLUSTERING_H
+
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/PointIndices.h>
+
+/**
+ * Euclidean clustering of points from an organized cloud, using the pixel grid of the
+ * camera instead of a KD-tree.
+ *
+ * Two points are connected if their pixels are at most pixel_radius apart and their
+ * 3D distance is within the cluster tolerance, so a depth discontinuity separates
+ * clusters. Connected points are merged with a union-find, which makes the cost
+ * linear in the number of points and needs no search structure.
+ */
+class OrganizedClustering
+{
+    public:
+        OrganizedClustering();
+        virtual ~OrganizedClustering();
+
+        void setClusterTolerance(float cluster_tolerance);
+        /**
+         * Clusters with fewer than min_cluster_size or more than max_cluster_size points are dropped
+         */
+        void setClusterSizeLimits(int min_cluster_size, int max_cluster_size);
+        /**
+         * Neighbourhood searched around every pixel; a radius above 1 bridges small
+         * holes of invalid depth
+         */
+        void setPixelRadius(int pixel_radius);
+
+        /**
+         * pixel_indices holds the index (row * width + column) in the organized cloud of
+         * every point of cloud. The clusters refer to indices into cloud
+         */
+        void cluster(const pcl::PointCloud<pcl::PointXYZ> &cloud, const std::vector<int> &pixel_indices,
+                     int width, int height, std::vector<pcl::PointIndices> &clusters);
+
+    private:
+        int findRoot(int index);
+
+        float cluster_tolerance;
+        int min_cluster_size;
+        int max_cluster_size;
+        int pixel_radius;
+
+        /**
+         * Index of the point at every pixel or -1, only the pixels set during a call are
+         * reset afterwards, so the image is not cleared for every frame
+         */
+        std::vector<int> pixel_to_point;
+        std::vector<int> parents;
+        std::vector<int> root_to_cluster;
+};
+#endif
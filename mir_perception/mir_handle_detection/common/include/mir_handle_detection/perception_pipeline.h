@@ -0,0 +1,221 @@
+#ifndef PERCEPTION_PIPELINE_H
+#define PERCEPTION_PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+
+#include <Eigen/Geometry>
+
+#include <yaml-cpp/yaml.h>
+
+typedef pcl::PointCloud<pcl::PointXYZ> PCloudT;
+
+/**
+ * Frame processed by a pipeline: a raw point buffer of width * height points as
+ * described in CropVoxelFilter::filter, and the transform into the output frame
+ */
+struct PipelineInput
+{
+    const uint8_t *data;
+    int width;
+    int height;
+    size_t point_step;
+    size_t xyz_offset;
+    Eigen::Affine3f transform;
+};
+
+/**
+ * Named buffers the stages of a pipeline read and write. They are created while the
+ * pipeline is loaded and reused for every frame, a name refers to a single kind of buffer
+ */
+class PipelineBuffers
+{
+    public:
+        PipelineBuffers();
+        virtual ~PipelineBuffers();
+
+        /**
+         * Return the buffer of the given name, which is created on the first call.
+         * Throws std::invalid_argument if the name is already used for another kind of buffer
+         */
+        PCloudT::Ptr getCloud(const std::string &name);
+        pcl::PointIndices::Ptr getIndices(const std::string &name);
+        pcl::ModelCoefficients::Ptr getCoefficients(const std::string &name);
+        std::vector<pcl::PointIndices> &getClusters(const std::string &name);
+        Eigen::Affine3f &getPose(const std::string &name);
+
+        /**
+         * Reserve room for num_points points in every cloud and index buffer, so that
+         * frames of up to that size do not allocate them
+         */
+        void reserve(size_t num_points);
+        void clear();
+
+    private:
+        void setKind(const std::string &name, const std::string &kind);
+
+        std::map<std::string, std::string> kinds;
+        std::map<std::string, PCloudT::Ptr> clouds;
+        std::map<std::string, pcl::PointIndices::Ptr> indices;
+        std::map<std::string, pcl::ModelCoefficients::Ptr> coefficients;
+        std::map<std::string, std::vector<pcl::PointIndices> > clusters;
+        std::map<std::string, Eigen::Affine3f, std::less<std::string>,
+                 Eigen::aligned_allocator<std::pair<const std::string, Eigen::Affine3f> > > poses;
+};
+
+/**
+ * Entry of a stage in the pipeline configuration
+ */
+struct StageConfig
+{
+    std::string name;
+    std::string type;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    /**
+     * The whole entry, holding the parameters of the stage
+     */
+    YAML::Node node;
+
+    /**
+     * Throws std::invalid_argument unless the number of inputs and outputs is within the limits
+     */
+    void checkBufferCount(size_t min_inputs, size_t max_inputs, size_t min_outputs, size_t max_outputs) const;
+};
+
+/**
+ * Value of key in node, or default_value if node has no such key
+ */
+template <typename T>
+T getParameter(const YAML::Node &node, const std::string &key, const T &default_value)
+{
+    if (!node[key])
+    {
+        return default_value;
+    }
+    return node[key].as<T>();
+}
+
+/**
+ * A vector given as a list of three numbers, or as a single number for all three
+ */
+Eigen::Vector3f getVector3Parameter(const YAML::Node &node, const std::string &key,
+                                    const Eigen::Vector3f &default_value);
+
+/**
+ * Step of a pipeline, see pipeline_stages.h for the available ones
+ */
+class PipelineStage
+{
+    public:
+        PipelineStage();
+        virtual ~PipelineStage();
+
+        /**
+         * Read the parameters and look up the input and output buffers. Throws
+         * std::invalid_argument or YAML::Exception for an invalid configuration
+         */
+        virtual void configure(const StageConfig &config, PipelineBuffers &buffers) = 0;
+        /**
+         * Process the current frame, returns false if there is nothing left to process,
+         * which ends the frame
+         */
+        virtual bool process(const PipelineInput &input) = 0;
+        /**
+         * Forget what was kept from previous frames, e.g. when looking at a new scene
+         */
+        virtual void reset();
+};
+
+/**
+ * Chain of processing stages declared in a YAML configuration:
+ *
+ *   max_points: 307200
+ *   stages:
+ *     - name: plane
+ *       type: plane_ransac
+ *       inputs: [voxelized]
+ *       outputs: [plane_inliers, plane_coefficients]
+ *       distance_threshold: 0.005
+ *
+ * Stages exchange data through named buffers; every input has to be the output of an
+ * earlier stage, and every buffer is written by one stage only. A stage runs once all
+ * stages producing its inputs have finished, stages which do not depend on each other
+ * run concurrently. The buffers are created when the pipeline is loaded and reserve
+ * room for max_points points. The duration of every stage of the last frame is kept.
+ */
+class PerceptionPipeline
+{
+    public:
+        struct StageTiming
+        {
+            std::string name;
+            std::string type;
+            /**
+             * Stages of the same level run concurrently
+             */
+            int level;
+            bool has_run;
+            double milliseconds;
+        };
+
+        PerceptionPipeline();
+        virtual ~PerceptionPipeline();
+
+        /**
+         * Replace the stages by those of config. Throws std::invalid_argument or
+         * YAML::Exception for an invalid configuration
+         */
+        void load(const YAML::Node &config);
+        void loadFile(const std::string &filename);
+
+        /**
+         * Run all stages on a frame, returns false if a stage ended it early
+         */
+        bool process(const PipelineInput &input);
+        void reset();
+
+        /**
+         * True if a stage writes the buffer of the given name
+         */
+        bool hasOutput(const std::string &name) const;
+        PipelineBuffers &getBuffers();
+        const std::vector<StageTiming> &getTimings() const;
+        /**
+         * Wall time of the last call to process, less than the sum of the stage
+         * durations if stages ran concurrently
+         */
+        double getMilliseconds() const;
+
+    private:
+        void loadStages(const YAML::Node &config);
+        void runStage(size_t index, const PipelineInput &input);
+
+        std::vector<boost::shared_ptr<PipelineStage> > stages;
+        /**
+         * Indices of the stages of every level
+         */
+        std::vector<std::vector<size_t> > levels;
+        /**
+         * Stage writing every buffer
+         */
+        std::map<std::string, size_t> producers;
+        PipelineBuffers buffers;
+
+        std::vector<StageTiming> timings;
+        std::vector<char> results;
+        std::vector<std::thread> threads;
+        double milliseconds;
+};
+#endif
@@ -0,0 +1,257 @@
+#ifndef PIPELINE_STAGES_H
+#define PIPELINE_STAGES_H
+
+#include <string>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/filters/extract_indices.h>
+#include <pcl/filters/passthrough.h>
+#include <pcl/filters/project_inliers.h>
+#include <pcl/filters/voxel_grid.h>
+#include <pcl/segmentation/extract_polygonal_prism_data.h>
+#include <pcl/segmentation/extract_clusters.h>
+#include <pcl/search/kdtree.h>
+#include <pcl/surface/convex_hull.h>
+
+#include <mir_handle_detection/crop_voxel_filter.h>
+#include <mir_handle_detection/handle_bar_fit.h>
+#include <mir_handle_detection/organized_clustering.h>
+#include <mir_handle_detection/perception_pipeline.h>
+#include <mir_handle_detection/plane_ransac.h>
+
+/**
+ * Create a stage of the given type, which is one of the names below.
+ * Throws std::invalid_argument for an unknown type
+ */
+boost::shared_ptr<PipelineStage> createPipelineStage(const std::string &type);
+
+/**
+ * crop_voxel, see CropVoxelFilter. Reads the raw input of the pipeline.
+ * outputs: [cropped cloud, voxelized cloud] and optionally [pixel indices] holding the
+ * index in the input of every cropped point.
+ * parameters: y_min, y_max, z_min, z_max, leaf_size
+ */
+class CropVoxelStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        CropVoxelFilter crop_voxel_filter;
+        PCloudT::Ptr cropped;
+        PCloudT::Ptr voxelized;
+        pcl::PointIndices::Ptr pixel_indices;
+};
+
+/**
+ * passthrough, see pcl::PassThrough.
+ * inputs: [cloud], outputs: [cloud].
+ * parameters: field_name, limit_min, limit_max, negative
+ */
+class PassThroughStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::PassThrough<pcl::PointXYZ> passthrough;
+        PCloudT::Ptr input_cloud;
+        PCloudT::Ptr output_cloud;
+};
+
+/**
+ * voxel_grid, see pcl::VoxelGrid.
+ * inputs: [cloud], outputs: [cloud].
+ * parameters: leaf_size
+ */
+class VoxelGridStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::VoxelGrid<pcl::PointXYZ> voxel_grid;
+        PCloudT::Ptr input_cloud;
+        PCloudT::Ptr output_cloud;
+};
+
+/**
+ * plane_ransac, see PlaneRansac.
+ * inputs: [cloud], outputs: [inlier indices, plane coefficients].
+ * parameters: distance_threshold, axis, eps_angle, max_iterations, probability, num_threads
+ */
+class PlaneRansacStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+        void reset();
+
+    private:
+        PlaneRansac plane_ransac;
+        PCloudT::Ptr input_cloud;
+        pcl::PointIndices::Ptr inliers;
+        pcl::ModelCoefficients::Ptr coefficients;
+};
+
+/**
+ * project_inliers, projects points onto a plane.
+ * inputs: [cloud, indices of the points to project, plane coefficients], outputs: [cloud]
+ */
+class ProjectInliersStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::ProjectInliers<pcl::PointXYZ> project_inliers;
+        PCloudT::Ptr input_cloud;
+        pcl::PointIndices::Ptr indices;
+        pcl::ModelCoefficients::Ptr coefficients;
+        PCloudT::Ptr output_cloud;
+};
+
+/**
+ * convex_hull, see pcl::ConvexHull.
+ * inputs: [cloud], outputs: [hull cloud]
+ */
+class ConvexHullStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::ConvexHull<pcl::PointXYZ> convex_hull;
+        PCloudT::Ptr input_cloud;
+        PCloudT::Ptr hull;
+};
+
+/**
+ * polygonal_prism, see pcl::ExtractPolygonalPrismData.
+ * inputs: [cloud, planar hull], outputs: [indices of the points inside the prism].
+ * parameters: height_min, height_max
+ */
+class PolygonalPrismStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::ExtractPolygonalPrismData<pcl::PointXYZ> extract_polygonal_prism;
+        PCloudT::Ptr input_cloud;
+        PCloudT::Ptr hull;
+        pcl::PointIndices::Ptr indices;
+};
+
+/**
+ * extract_indices, see pcl::ExtractIndices.
+ * inputs: [cloud, indices], outputs: [cloud].
+ * parameters: negative
+ */
+class ExtractIndicesStage : public PipelineStage
+{
+    public:
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::ExtractIndices<pcl::PointXYZ> extract_indices;
+        PCloudT::Ptr input_cloud;
+        pcl::PointIndices::Ptr indices;
+        PCloudT::Ptr output_cloud;
+};
+
+/**
+ * euclidean_clustering, see pcl::EuclideanClusterExtraction. The KD-tree is rebuilt in
+ * place for every frame.
+ * inputs: [cloud], outputs: [clusters].
+ * parameters: cluster_tolerance, min_cluster_size, max_cluster_size
+ */
+class EuclideanClusteringStage : public PipelineStage
+{
+    public:
+        EuclideanClusteringStage();
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> euclidean_cluster_extraction;
+        pcl::search::KdTree<pcl::PointXYZ>::Ptr tree;
+        PCloudT::Ptr input_cloud;
+        std::vector<pcl::PointIndices> *clusters;
+};
+
+/**
+ * organized_clustering, see OrganizedClustering. Unorganized inputs are clustered
+ * with a KD-tree instead.
+ * inputs: [cloud, indices of its points in the cropped cloud, pixel indices of the
+ * cropped cloud as written by crop_voxel], outputs: [clusters].
+ * parameters: cluster_tolerance, min_cluster_size, max_cluster_size, pixel_radius
+ */
+class OrganizedClusteringStage : public PipelineStage
+{
+    public:
+        OrganizedClusteringStage();
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        OrganizedClustering organized_clustering;
+        pcl::EuclideanClusterExtraction<pcl::PointXYZ> euclidean_cluster_extraction;
+        pcl::search::KdTree<pcl::PointXYZ>::Ptr tree;
+        PCloudT::Ptr input_cloud;
+        pcl::PointIndices::Ptr cropped_indices;
+        pcl::PointIndices::Ptr cropped_pixel_indices;
+        std::vector<pcl::PointIndices> *clusters;
+        /**
+         * Pixel of every point of the input cloud
+         */
+        std::vector<int> pixel_indices;
+};
+
+/**
+ * closest_cluster, the centroid of the cluster closest to the origin of the output frame.
+ * inputs: [cloud, clusters], outputs: [pose], whose rotation is the identity
+ */
+class ClosestClusterStage : public PipelineStage
+{
+    public:
+        ClosestClusterStage();
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        PCloudT::Ptr input_cloud;
+        std::vector<pcl::PointIndices> *clusters;
+        Eigen::Affine3f *pose;
+};
+
+/**
+ * handle_fit, see HandleBarFit.
+ * inputs: [cloud, drawer plane coefficients], outputs: [pose] and optionally [indices of the
+ * points of the handle].
+ * parameters: distance_threshold, eps_angle, max_iterations, probability, min_inliers,
+ * radius_min, radius_max, length_min, length_max
+ */
+class HandleFitStage : public PipelineStage
+{
+    public:
+        HandleFitStage();
+        void configure(const StageConfig &config, PipelineBuffers &buffers);
+        bool process(const PipelineInput &input);
+
+    private:
+        HandleBarFit handle_bar_fit;
+        PCloudT::Ptr input_cloud;
+        pcl::ModelCoefficients::Ptr coefficients;
+        Eigen::Affine3f *pose;
+        pcl::PointIndices::Ptr inliers;
+};
+#endif
@@ -0,0 +1,102 @@
+#ifndef PLANE_RANSAC_H
+#define PLANE_RANSAC_H
+
+#include <stdint.h>
+#include <vector>
+
+#include <pcl/point_types.h>
+#include <pcl/point_cloud.h>
+#include <pcl/ModelCoefficients.h>
+#include <pcl/PointIndices.h>
+
+#include <Eigen/Core>
+#include <Eigen/StdVector>
+
+/**
+ * RANSAC fit of a plane whose normal is (close to) parallel to a given axis, the
+ * equivalent of pcl::SACSegmentation with SACMODEL_PERPENDICULAR_PLANE and
+ * setOptimizeCoefficients(true).
+ *
+ * Hypotheses are scored on several threads, each of which draws its own share of the
+ * iterations from its own generator and keeps its own best plane, so for a fixed
+ * number of threads the result does not depend on their scheduling. The number of
+ * iterations adapts to the best inlier ratio a thread has found so far, and scoring a
+ * hypothesis stops as soon as it can no longer beat that one. The plane of the
+ * previous call is scored first, so when the drawer has not moved the required number
+ * of iterations is small from the start.
+ */
+class PlaneRansac
+{
+    public:
+        PlaneRansac();
+        virtual ~PlaneRansac();
+
+        void setDistanceThreshold(float distance_threshold);
+        /**
+         * Planes whose normal deviates more than eps_angle (radians) from axis are
+         * rejected; with eps_angle 0 every plane is accepted, like in pcl::SACSegmentation
+         */
+        void setAxis(const Eigen::Vector3f &axis, float eps_angle);
+        /**
+         * max_iterations bounds the number of hypotheses, fewer are scored once the
+         * plane has been found with the given probability
+         */
+        void setMaxIterations(int max_iterations, double probability);
+        /**
+         * 0 uses one thread per core
+         */
+        void setNumThreads(int num_threads);
+        /**
+         * Do not seed the next call with the last plane, e.g. when looking at a new scene
+         */
+        void clearPreviousPlane();
+
+        /**
+         * Fit the plane, coefficients are a, b, c, d of ax + by + cz + d = 0.
+         * Returns false if no valid plane was found
+         */
+        bool segment(const pcl::PointCloud<pcl::PointXYZ> &cloud, pcl::PointIndices &inliers,
+                     pcl::ModelCoefficients &coefficients);
+
+    private:
+        /**
+         * Score the share of the hypotheses of one of num_threads threads and store its best
+         * plane in thread_planes
+         */
+        void scoreHypotheses(int thread_index, int num_threads);
+        /**
+         * Number of inliers of plane, or a number <= count_to_beat once it can no longer exceed it
+         */
+        int countInliers(const Eigen::Vector4f &plane, int count_to_beat) const;
+        int computeRequiredIterations(int inlier_count) const;
+        bool isValid(const Eigen::Vector4f &plane) const;
+        /**
+         * Least squares fit of the plane to its inliers
+         */
+        Eigen::Vector4f refinePlane(const Eigen::Vector4f &plane, const std::vector<int> &indices) const;
+        void collectInliers(const Eigen::Vector4f &plane, std::vector<int> &indices) const;
+
+        float distance_threshold;
+        Eigen::Vector3f axis;
+        float eps_angle;
+        int max_iterations;
+        double probability;
+        int num_threads;
+
+        bool has_previous_plane;
+        Eigen::Vector4f previous_plane;
+        uint32_t num_calls;
+
+        /**
+         * Input of segment, and the plane the threads start from with its inlier count
+         */
+        const pcl::PointCloud<pcl::PointXYZ> *cloud;
+        Eigen::Vector4f seed_plane;
+        int seed_inlier_count;
+        /**
+         * Best plane and its inlier count found by every thread
+         */
+        std::vector<Eigen::Vector4f, Eigen::aligned_allocator<Eigen::Vector4f> > thread_planes;
+        std::vector<int> thread_inlier_counts;
+};
+#endif
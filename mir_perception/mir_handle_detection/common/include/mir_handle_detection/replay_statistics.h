@@ -0,0 +1,73 @@
+#ifndef REPLAY_STATISTICS_H
+#define REPLAY_STATISTICS_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include <yaml-cpp/yaml.h>
+
+#include <mir_handle_detection/drawer_handle_detector.h>
+
+/**
+ * Labelled pose of the handle in the output frame
+ */
+struct HandleLabel
+{
+    Eigen::Vector3f position;
+    /**
+     * Direction of the bar, only compared if has_axis is set and the detector estimates
+     * the orientation
+     */
+    Eigen::Vector3f axis;
+    bool has_axis;
+};
+
+/**
+ * Read a label given as {position: [x, y, z], axis: [x, y, z]}, axis being optional.
+ * Throws YAML::Exception for an invalid label
+ */
+HandleLabel parseHandleLabel(const YAML::Node &node);
+
+/**
+ * Collects the results of replaying recorded clouds through a DrawerHandleDetector: the
+ * detection rate, the throughput, percentiles of the latency of every pipeline stage and
+ * the deviation of the detected handle poses from their labels.
+ */
+class ReplayStatistics
+{
+    public:
+        ReplayStatistics();
+        virtual ~ReplayStatistics();
+
+        /**
+         * Record the last call to detector.detect, label is NULL for a frame without label
+         */
+        void addFrame(const DrawerHandleDetector &detector, bool is_found, const Eigen::Affine3f &handle_pose,
+                      const HandleLabel *label);
+        /**
+         * Frames which could not be passed to the detector, e.g. without a transform
+         */
+        void addSkippedFrame();
+        void print(FILE *stream) const;
+
+    private:
+        /**
+         * Print the mean, p50, p90, p99 and the maximum of values, which are reordered
+         */
+        static void printPercentiles(FILE *stream, const std::string &name, std::vector<double> &values);
+
+        int num_frames;
+        int num_skipped;
+        int num_found;
+        int num_labelled;
+        bool has_orientation;
+        std::vector<double> frame_milliseconds;
+        std::vector<std::string> stage_names;
+        std::vector<std::vector<double> > stage_milliseconds;
+        std::vector<double> position_errors;
+        std::vector<double> axis_errors;
+};
+#endif
@@ -0,0 +1,211 @@
+#include <mir_handle_detection/crop_voxel_filter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+
+namespace
+{
+/**
+ * Number of points transformed and cropped at once, small enough for the
+ * coordinate arrays to stay in the L1 cache
+ */
+const size_t BLOCK_SIZE = 256;
+
+/**
+ * Each voxel index is stored in 21 bits of the key
+ */
+const int KEY_BITS = 21;
+const int64_t KEY_OFFSET = static_cast<int64_t>(1) << (KEY_BITS - 1);
+const int64_t KEY_MASK = (static_cast<int64_t>(1) << KEY_BITS) - 1;
+
+/**
+ * Keys use 3 * KEY_BITS bits, so this marks an empty slot of the voxel hash
+ */
+const uint64_t EMPTY_KEY = ~static_cast<uint64_t>(0);
+const int MIN_VOXEL_HASH_BITS = 10;
+/**
+ * Fibonacci hashing, the upper bits of the product select the slot
+ */
+const uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ull;
+}
+
+CropVoxelFilter::CropVoxelFilter() :
+    transform(Eigen::Affine3f::Identity()),
+    y_min(-1.0), y_max(1.0), z_min(-1.0), z_max(1.0),
+    inverse_leaf_size(100.0, 100.0, 100.0),
+    voxel_keys(static_cast<size_t>(1) << MIN_VOXEL_HASH_BITS, EMPTY_KEY),
+    voxel_indices(static_cast<size_t>(1) << MIN_VOXEL_HASH_BITS, 0),
+    voxel_hash_bits(MIN_VOXEL_HASH_BITS)
+{
+}
+
+CropVoxelFilter::~CropVoxelFilter()
+{
+}
+
+void CropVoxelFilter::setTransform(const Eigen::Affine3f &transform)
+{
+    this->transform = transform;
+}
+
+void CropVoxelFilter::setCropBox(float y_min, float y_max, float z_min, float z_max)
+{
+    this->y_min = y_min;
+    this->y_max = y_max;
+    this->z_min = z_min;
+    this->z_max = z_max;
+}
+
+void CropVoxelFilter::setLeafSize(float leaf_size_x, float leaf_size_y, float leaf_size_z)
+{
+    this->inverse_leaf_size = Eigen::Array3f(1.0 / leaf_size_x, 1.0 / leaf_size_y, 1.0 / leaf_size_z);
+}
+
+const std::vector<int> &CropVoxelFilter::getCroppedIndices() const
+{
+    return this->cropped_indices;
+}
+
+uint64_t CropVoxelFilter::computeKey(float x, float y, float z) const
+{
+    int64_t ix = static_cast<int64_t>(std::floor(x * this->inverse_leaf_size[0])) + KEY_OFFSET;
+    int64_t iy = static_cast<int64_t>(std::floor(y * this->inverse_leaf_size[1])) + KEY_OFFSET;
+    int64_t iz = static_cast<int64_t>(std::floor(z * this->inverse_leaf_size[2])) + KEY_OFFSET;
+
+    return (static_cast<uint64_t>(ix & KEY_MASK) << (2 * KEY_BITS)) |
+           (static_cast<uint64_t>(iy & KEY_MASK) << KEY_BITS) |
+           static_cast<uint64_t>(iz & KEY_MASK);
+}
+
+int CropVoxelFilter::getVoxelIndex(uint64_t key)
+{
+    // at most half full, so probe sequences stay short
+    if (2 * (this->voxels.size() + 1) > this->voxel_keys.size())
+    {
+        this->growVoxelHash();
+    }
+
+    size_t mask = this->voxel_keys.size() - 1;
+    size_t slot = (key * HASH_MULTIPLIER) >> (64 - this->voxel_hash_bits);
+    while (this->voxel_keys[slot] != key)
+    {
+        if (this->voxel_keys[slot] == EMPTY_KEY)
+        {
+            Voxel voxel;
+            voxel.sum_x = 0.0;
+            voxel.sum_y = 0.0;
+            voxel.sum_z = 0.0;
+            voxel.num_points = 0;
+            this->voxel_keys[slot] = key;
+            this->voxel_indices[slot] = static_cast<int>(this->voxels.size());
+            this->voxels.push_back(voxel);
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return this->voxel_indices[slot];
+}
+
+void CropVoxelFilter::growVoxelHash()
+{
+    std::vector<uint64_t> old_keys(this->voxel_keys.size() * 2, EMPTY_KEY);
+    std::vector<int> old_indices(this->voxel_indices.size() * 2, 0);
+    old_keys.swap(this->voxel_keys);
+    old_indices.swap(this->voxel_indices);
+    this->voxel_hash_bits++;
+
+    size_t mask = this->voxel_keys.size() - 1;
+    for (size_t i = 0; i < old_keys.size(); i++)
+    {
+        if (old_keys[i] == EMPTY_KEY)
+        {
+            continue;
+        }
+        size_t slot = (old_keys[i] * HASH_MULTIPLIER) >> (64 - this->voxel_hash_bits);
+        while (this->voxel_keys[slot] != EMPTY_KEY)
+        {
+            slot = (slot + 1) & mask;
+        }
+        this->voxel_keys[slot] = old_keys[i];
+        this->voxel_indices[slot] = old_indices[i];
+    }
+}
+
+void CropVoxelFilter::filter(const uint8_t *data, size_t num_points, size_t point_step, size_t xyz_offset,
+                             pcl::PointCloud<pcl::PointXYZ> &cropped, pcl::PointCloud<pcl::PointXYZ> &voxelized)
+{
+    cropped.points.clear();
+    this->cropped_indices.clear();
+    std::fill(this->voxel_keys.begin(), this->voxel_keys.end(), EMPTY_KEY);
+    this->voxels.clear();
+
+    const Eigen::Matrix3f rotation = this->transform.linear();
+    const Eigen::Vector3f translation = this->transform.translation();
+
+    float x[BLOCK_SIZE], y[BLOCK_SIZE], z[BLOCK_SIZE];
+    float tx[BLOCK_SIZE], ty[BLOCK_SIZE], tz[BLOCK_SIZE];
+    uint8_t is_inside[BLOCK_SIZE];
+
+    for (size_t block_start = 0; block_start < num_points; block_start += BLOCK_SIZE)
+    {
+        size_t block_size = std::min(BLOCK_SIZE, num_points - block_start);
+
+        // gather the strided fields, memcpy since the buffer need not be float aligned
+        const uint8_t *point = data + block_start * point_step + xyz_offset;
+        for (size_t i = 0; i < block_size; i++, point += point_step)
+        {
+            float xyz[3];
+            memcpy(xyz, point, sizeof(xyz));
+            x[i] = xyz[0];
+            y[i] = xyz[1];
+            z[i] = xyz[2];
+        }
+
+        // branch free, so these loops are vectorised
+        for (size_t i = 0; i < block_size; i++)
+        {
+            tx[i] = rotation(0, 0) * x[i] + rotation(0, 1) * y[i] + rotation(0, 2) * z[i] + translation[0];
+            ty[i] = rotation(1, 0) * x[i] + rotation(1, 1) * y[i] + rotation(1, 2) * z[i] + translation[1];
+            tz[i] = rotation(2, 0) * x[i] + rotation(2, 1) * y[i] + rotation(2, 2) * z[i] + translation[2];
+        }
+        for (size_t i = 0; i < block_size; i++)
+        {
+            // comparisons with NaN are false, so invalid points are outside
+            is_inside[i] = (tx[i] == tx[i]) & (ty[i] >= this->y_min) & (ty[i] <= this->y_max) &
+                           (tz[i] >= this->z_min) & (tz[i] <= this->z_max);
+        }
+
+        for (size_t i = 0; i < block_size; i++)
+        {
+            if (!is_inside[i])
+            {
+                continue;
+            }
+            cropped.points.push_back(pcl::PointXYZ(tx[i], ty[i], tz[i]));
+            this->cropped_indices.push_back(block_start + i);
+
+            Voxel &voxel = this->voxels[this->getVoxelIndex(this->computeKey(tx[i], ty[i], tz[i]))];
+            voxel.sum_x += tx[i];
+            voxel.sum_y += ty[i];
+            voxel.sum_z += tz[i];
+            voxel.num_points++;
+        }
+    }
+
+    cropped.width = cropped.points.size();
+    cropped.height = 1;
+    cropped.is_dense = true;
+
+    voxelized.points.resize(this->voxels.size());
+    for (size_t i = 0; i < this->voxels.size(); i++)
+    {
+        const Voxel &voxel = this->voxels[i];
+        float inverse_num_points = 1.0 / voxel.num_points;
+        voxelized.points[i] = pcl::PointXYZ(voxel.sum_x * inverse_num_points, voxel.sum_y * inverse_num_points,
+                                            voxel.sum_z * inverse_num_points);
+    }
+    voxelized.width = voxelized.points.size();
+    voxelized.height = 1;
+    voxelized.is_dense = true;
+}
@@ -0,0 +1,99 @@
+#include <mir_handle_detection/drawer_handle_detector.h>
+
+#include <stdexcept>
+
+DrawerHandleDetector::DrawerHandleDetector() :
+    handle_pose(NULL),
+    has_orientation(false),
+    segmented_cloud(new PCloudT)
+{
+}
+
+DrawerHandleDetector::~DrawerHandleDetector()
+{
+}
+
+void DrawerHandleDetector::configure(const YAML::Node &config)
+{
+    this->handle_pose = NULL;
+    this->segmented_cloud.reset(new PCloudT);
+    this->pipeline.load(config);
+
+    std::string handle_pose_name = getParameter<std::string>(config, "handle_pose", "handle_pose");
+    std::string segmented_cloud_name = getParameter<std::string>(config, "segmented_cloud", "segmented");
+    if (!this->pipeline.hasOutput(handle_pose_name) || !this->pipeline.hasOutput(segmented_cloud_name))
+    {
+        throw std::invalid_argument("no stage writes " + handle_pose_name + " or " + segmented_cloud_name);
+    }
+    this->handle_pose = &this->pipeline.getBuffers().getPose(handle_pose_name);
+    this->segmented_cloud = this->pipeline.getBuffers().getCloud(segmented_cloud_name);
+    this->has_orientation = getParameter<bool>(config, "handle_orientation", false);
+}
+
+void DrawerHandleDetector::configureFromFile(const std::string &filename)
+{
+    this->configure(YAML::LoadFile(filename));
+}
+
+bool DrawerHandleDetector::detect(const uint8_t *data, int width, int height, size_t point_step, size_t xyz_offset,
+                                  const Eigen::Affine3f &transform, Eigen::Affine3f &handle_pose)
+{
+    if (!this->handle_pose)
+    {
+        return false;
+    }
+    // stages after a failed one do not run, so do not show the cloud of an earlier frame
+    this->segmented_cloud->points.clear();
+    this->segmented_cloud->width = 0;
+
+    PipelineInput input;
+    input.data = data;
+    input.width = width;
+    input.height = height;
+    input.point_step = point_step;
+    input.xyz_offset = xyz_offset;
+    input.transform = transform;
+    if (!this->pipeline.process(input))
+    {
+        return false;
+    }
+
+    handle_pose = *this->handle_pose;
+    return true;
+}
+
+bool DrawerHandleDetector::detect(const PCloudT &cloud, const Eigen::Affine3f &transform, Eigen::Affine3f &handle_pose)
+{
+    if (cloud.points.empty())
+    {
+        return false;
+    }
+    // x, y and z are the first fields of a pcl::PointXYZ
+    return this->detect(reinterpret_cast<const uint8_t *>(cloud.points.data()), cloud.width, cloud.height,
+                        sizeof(pcl::PointXYZ), 0, transform, handle_pose);
+}
+
+bool DrawerHandleDetector::hasOrientation() const
+{
+    return this->has_orientation;
+}
+
+PCloudT::ConstPtr DrawerHandleDetector::getSegmentedCloud() const
+{
+    return this->segmented_cloud;
+}
+
+const std::vector<PerceptionPipeline::StageTiming> &DrawerHandleDetector::getTimings() const
+{
+    return this->pipeline.getTimings();
+}
+
+double DrawerHandleDetector::getMilliseconds() const
+{
+    return this->pipeline.getMilliseconds();
+}
+
+void DrawerHandleDetector::reset()
+{
+    this->pipeline.reset();
+}
@@ -0,0 +1,249 @@
+#include <mir_handle_detection/handle_bar_fit.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include <Eigen/Eigenvalues>
+
+namespace
+{
+/**
+ * Number of points after which scoring checks whether the hypothesis can still win
+ */
+const size_t EARLY_TERMINATION_STEP = 64;
+}
+
+HandleBarFit::HandleBarFit() :
+    distance_threshold(0.02), eps_angle(0.2), max_iterations(200), probability(0.99), min_inliers(10),
+    radius_min(0.0), radius_max(0.015), length_min(0.03), length_max(0.6), num_calls(0)
+{
+}
+
+HandleBarFit::~HandleBarFit()
+{
+}
+
+void HandleBarFit::setDistanceThreshold(float distance_threshold)
+{
+    this->distance_threshold = distance_threshold;
+}
+
+void HandleBarFit::setEpsAngle(float eps_angle)
+{
+    this->eps_angle = eps_angle;
+}
+
+void HandleBarFit::setMaxIterations(int max_iterations, double probability)
+{
+    this->max_iterations = std::max(max_iterations, 1);
+    this->probability = probability;
+}
+
+void HandleBarFit::setMinInliers(int min_inliers)
+{
+    this->min_inliers = std::max(min_inliers, 2);
+}
+
+void HandleBarFit::setRadiusLimits(float radius_min, float radius_max)
+{
+    this->radius_min = radius_min;
+    this->radius_max = radius_max;
+}
+
+void HandleBarFit::setLengthLimits(float length_min, float length_max)
+{
+    this->length_min = length_min;
+    this->length_max = length_max;
+}
+
+const std::vector<int> &HandleBarFit::getInliers() const
+{
+    return this->inliers;
+}
+
+bool HandleBarFit::fit(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector4f &plane,
+                       Eigen::Affine3f &pose)
+{
+    this->inliers.clear();
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = cloud.points;
+    float normal_norm = plane.head<3>().norm();
+    if (static_cast<int>(points.size()) < this->min_inliers || normal_norm < std::numeric_limits<float>::epsilon())
+    {
+        return false;
+    }
+    Eigen::Vector3f normal = plane.head<3>() / normal_norm;
+    float max_normal_component = std::sin(this->eps_angle);
+
+    // different samples in every call, but reproducible
+    std::mt19937 generator(this->num_calls++);
+    std::uniform_int_distribution<int> distribution(0, points.size() - 1);
+
+    int best_inlier_count = 0;
+    Eigen::Vector3f best_point = Eigen::Vector3f::Zero();
+    Eigen::Vector3f best_direction = Eigen::Vector3f::Zero();
+    int required_iterations = this->max_iterations;
+    for (int iteration = 0; iteration < required_iterations; iteration++)
+    {
+        int index_0 = distribution(generator);
+        int index_1 = distribution(generator);
+        Eigen::Vector3f point = points[index_0].getVector3fMap();
+        Eigen::Vector3f direction = points[index_1].getVector3fMap() - point;
+        // points across the bar give no direction along it
+        float length = direction.norm();
+        if (length < this->distance_threshold)
+        {
+            continue;
+        }
+        direction /= length;
+        if (std::fabs(direction.dot(normal)) > max_normal_component)
+        {
+            continue;
+        }
+
+        int inlier_count = this->countInliers(cloud, point, direction, best_inlier_count);
+        if (inlier_count > best_inlier_count)
+        {
+            best_inlier_count = inlier_count;
+            best_point = point;
+            best_direction = direction;
+            required_iterations = this->computeRequiredIterations(inlier_count, points.size());
+        }
+    }
+    if (best_inlier_count < this->min_inliers)
+    {
+        return false;
+    }
+
+    // the bar is along the direction of largest variance of its points, kept parallel to the drawer front
+    this->collectInliers(cloud, best_point, best_direction);
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    for (size_t i = 0; i < this->inliers.size(); i++)
+    {
+        centroid += points[this->inliers[i]].getVector3fMap();
+    }
+    centroid /= this->inliers.size();
+    Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+    for (size_t i = 0; i < this->inliers.size(); i++)
+    {
+        Eigen::Vector3f delta = points[this->inliers[i]].getVector3fMap() - centroid;
+        covariance += delta * delta.transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+    Eigen::Vector3f axis = solver.eigenvectors().col(2);
+    axis -= axis.dot(normal) * normal;
+    if (axis.norm() < std::numeric_limits<float>::epsilon())
+    {
+        return false;
+    }
+    axis.normalize();
+
+    this->collectInliers(cloud, centroid, axis);
+    if (static_cast<int>(this->inliers.size()) < this->min_inliers)
+    {
+        return false;
+    }
+
+    // extent along the bar and spread across it on the drawer front, relative to the first centroid
+    Eigen::Vector3f across = normal.cross(axis);
+    Eigen::Vector3f mean_delta = Eigen::Vector3f::Zero();
+    float min_along = std::numeric_limits<float>::max();
+    float max_along = -std::numeric_limits<float>::max();
+    for (size_t i = 0; i < this->inliers.size(); i++)
+    {
+        Eigen::Vector3f delta = points[this->inliers[i]].getVector3fMap() - centroid;
+        float along = delta.dot(axis);
+        min_along = std::min(min_along, along);
+        max_along = std::max(max_along, along);
+        mean_delta += delta;
+    }
+    mean_delta /= this->inliers.size();
+    float mean_across = mean_delta.dot(across);
+    float variance_across = 0.0;
+    for (size_t i = 0; i < this->inliers.size(); i++)
+    {
+        float delta_across = (points[this->inliers[i]].getVector3fMap() - centroid).dot(across) - mean_across;
+        variance_across += delta_across * delta_across;
+    }
+    variance_across /= this->inliers.size();
+
+    // points spread uniformly across a bar of radius r have a standard deviation of r / sqrt(3)
+    float length = max_along - min_along;
+    float radius = std::sqrt(3.0 * variance_across);
+    if (length < this->length_min || length > this->length_max || radius < this->radius_min ||
+        radius > this->radius_max)
+    {
+        return false;
+    }
+
+    Eigen::Vector3f position = centroid + mean_delta + axis * (0.5 * (min_along + max_along) - mean_delta.dot(axis));
+    // the point of the plane closest to the origin is -d * normal
+    Eigen::Vector3f x_axis = plane[3] > 0.0 ? Eigen::Vector3f(-normal) : normal;
+    Eigen::Vector3f::Index largest_component;
+    axis.cwiseAbs().maxCoeff(&largest_component);
+    Eigen::Vector3f y_axis = axis[largest_component] < 0.0 ? Eigen::Vector3f(-axis) : axis;
+
+    Eigen::Matrix3f rotation;
+    rotation.col(0) = x_axis;
+    rotation.col(1) = y_axis;
+    rotation.col(2) = x_axis.cross(y_axis);
+    pose = Eigen::Translation3f(position) * Eigen::Quaternionf(rotation);
+    return true;
+}
+
+int HandleBarFit::countInliers(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector3f &point,
+                               const Eigen::Vector3f &direction, int count_to_beat) const
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = cloud.points;
+    size_t num_points = points.size();
+    float squared_threshold = this->distance_threshold * this->distance_threshold;
+    int count = 0;
+
+    for (size_t start = 0; start < num_points; start += EARLY_TERMINATION_STEP)
+    {
+        if (count + static_cast<int>(num_points - start) <= count_to_beat)
+        {
+            return count;
+        }
+
+        size_t end = std::min(start + EARLY_TERMINATION_STEP, num_points);
+        for (size_t i = start; i < end; i++)
+        {
+            Eigen::Vector3f delta = points[i].getVector3fMap() - point;
+            float along = delta.dot(direction);
+            count += (delta.squaredNorm() - along * along <= squared_threshold);
+        }
+    }
+    return count;
+}
+
+void HandleBarFit::collectInliers(const pcl::PointCloud<pcl::PointXYZ> &cloud, const Eigen::Vector3f &point,
+                                  const Eigen::Vector3f &direction)
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = cloud.points;
+    float squared_threshold = this->distance_threshold * this->distance_threshold;
+
+    this->inliers.clear();
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        Eigen::Vector3f delta = points[i].getVector3fMap() - point;
+        float along = delta.dot(direction);
+        if (delta.squaredNorm() - along * along <= squared_threshold)
+        {
+            this->inliers.push_back(i);
+        }
+    }
+}
+
+int HandleBarFit::computeRequiredIterations(int inlier_count, size_t num_points) const
+{
+    // probability that a sample of two points contains an outlier
+    double inlier_ratio = static_cast<double>(inlier_count) / num_points;
+    double outlier_sample_probability = 1.0 - inlier_ratio * inlier_ratio;
+    outlier_sample_probability = std::max(outlier_sample_probability, std::numeric_limits<double>::epsilon());
+    outlier_sample_probability = std::min(outlier_sample_probability, 1.0 - std::numeric_limits<double>::epsilon());
+
+    double iterations = std::ceil(std::log(1.0 - this->probability) / std::log(outlier_sample_probability));
+    return static_cast<int>(std::min(iterations, static_cast<double>(this->max_iterations)));
+}
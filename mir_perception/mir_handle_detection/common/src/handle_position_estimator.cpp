@@ -0,0 +1,187 @@
+#include <mir_handle_detection/handle_position_estimator.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Eigenvalues>
+
+HandlePositionEstimator::HandlePositionEstimator() :
+    window_size(10), min_inliers(3), outlier_distance(0.02), convergence_stddev(0.005),
+    position(Eigen::Vector3f::Zero()), covariance(Eigen::Matrix3f::Zero()), orientation(Eigen::Quaternionf::Identity()),
+    orientation_variance(0.0), num_inliers(0), is_converged(false)
+{
+}
+
+HandlePositionEstimator::~HandlePositionEstimator()
+{
+}
+
+void HandlePositionEstimator::setParameters(int window_size, int min_inliers, float outlier_distance,
+                                            float convergence_stddev)
+{
+    this->window_size = std::max(window_size, 1);
+    this->min_inliers = std::min(std::max(min_inliers, 1), this->window_size);
+    this->outlier_distance = outlier_distance;
+    this->convergence_stddev = convergence_stddev;
+}
+
+void HandlePositionEstimator::reset()
+{
+    this->detections.clear();
+    this->orientations.clear();
+    this->position = Eigen::Vector3f::Zero();
+    this->covariance = Eigen::Matrix3f::Zero();
+    this->orientation = Eigen::Quaternionf::Identity();
+    this->orientation_variance = 0.0;
+    this->num_inliers = 0;
+    this->is_converged = false;
+}
+
+void HandlePositionEstimator::addDetection(const Eigen::Vector3f &position, const Eigen::Quaternionf &orientation)
+{
+    this->detections.push_back(position);
+    this->orientations.push_back(orientation.normalized());
+    if (static_cast<int>(this->detections.size()) > this->window_size)
+    {
+        this->detections.pop_front();
+        this->orientations.pop_front();
+    }
+    this->update();
+}
+
+bool HandlePositionEstimator::isConverged() const
+{
+    return this->is_converged;
+}
+
+int HandlePositionEstimator::getNumDetections() const
+{
+    return this->detections.size();
+}
+
+bool HandlePositionEstimator::getEstimate(Eigen::Vector3f &position, Eigen::Matrix3f &covariance) const
+{
+    if (this->detections.empty())
+    {
+        return false;
+    }
+    position = this->position;
+    covariance = this->covariance;
+    return true;
+}
+
+bool HandlePositionEstimator::getOrientation(Eigen::Quaternionf &orientation, float &variance) const
+{
+    if (this->detections.empty())
+    {
+        return false;
+    }
+    orientation = this->orientation;
+    variance = this->orientation_variance;
+    return true;
+}
+
+void HandlePositionEstimator::update()
+{
+    // the median is not pulled away by a wrong cluster, unlike the mean
+    Eigen::Vector3f median;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        this->values.clear();
+        for (size_t i = 0; i < this->detections.size(); i++)
+        {
+            this->values.push_back(this->detections[i][axis]);
+        }
+        std::vector<float>::iterator middle = this->values.begin() + this->values.size() / 2;
+        std::nth_element(this->values.begin(), middle, this->values.end());
+        median[axis] = *middle;
+    }
+
+    Eigen::Vector3f sum = Eigen::Vector3f::Zero();
+    this->num_inliers = 0;
+    this->is_inlier.resize(this->detections.size());
+    for (size_t i = 0; i < this->detections.size(); i++)
+    {
+        this->is_inlier[i] = (this->detections[i] - median).norm() <= this->outlier_distance;
+        if (this->is_inlier[i])
+        {
+            sum += this->detections[i];
+            this->num_inliers++;
+        }
+    }
+
+    if (this->num_inliers == 0)
+    {
+        // no two detections agree, keep the latest one until more arrive
+        this->position = this->detections.back();
+        this->covariance = Eigen::Matrix3f::Identity() * this->outlier_distance * this->outlier_distance;
+        this->orientation = this->orientations.back();
+        this->orientation_variance = M_PI * M_PI;
+        this->is_converged = false;
+        return;
+    }
+
+    this->position = sum / this->num_inliers;
+    Eigen::Matrix3f spread = Eigen::Matrix3f::Zero();
+    for (size_t i = 0; i < this->detections.size(); i++)
+    {
+        Eigen::Vector3f delta = this->detections[i] - this->position;
+        if (this->is_inlier[i])
+        {
+            spread += delta * delta.transpose();
+        }
+    }
+    spread /= this->num_inliers;
+    // the covariance of the mean shrinks with the number of detections, a single
+    // detection is only known to be within the outlier distance
+    this->covariance = spread / this->num_inliers;
+    if (this->num_inliers < 2)
+    {
+        this->covariance = Eigen::Matrix3f::Identity() * this->outlier_distance * this->outlier_distance;
+    }
+
+    this->updateOrientation();
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(spread);
+    float max_variance = solver.eigenvalues().maxCoeff();
+    this->is_converged = (this->num_inliers >= this->min_inliers) &&
+                         (max_variance <= this->convergence_stddev * this->convergence_stddev);
+}
+
+void HandlePositionEstimator::updateOrientation()
+{
+    // q and -q are the same rotation, so align all quaternions with the latest inlier before summing
+    int reference = this->detections.size() - 1;
+    while (!this->is_inlier[reference])
+    {
+        reference--;
+    }
+    Eigen::Vector4f sum = Eigen::Vector4f::Zero();
+    for (size_t i = 0; i < this->orientations.size(); i++)
+    {
+        if (this->is_inlier[i])
+        {
+            const Eigen::Quaternionf &orientation = this->orientations[i];
+            float sign = orientation.dot(this->orientations[reference]) < 0.0 ? -1.0 : 1.0;
+            sum += sign * orientation.coeffs();
+        }
+    }
+    this->orientation = Eigen::Quaternionf(sum / sum.norm());
+
+    if (this->num_inliers < 2)
+    {
+        this->orientation_variance = M_PI * M_PI;
+        return;
+    }
+    float squared_angles = 0.0;
+    for (size_t i = 0; i < this->orientations.size(); i++)
+    {
+        if (this->is_inlier[i])
+        {
+            float angle = this->orientations[i].angularDistance(this->orientation);
+            squared_angles += angle * angle;
+        }
+    }
+    // as for the position, the variance of the mean
+    this->orientation_variance = squared_angles / this->num_inliers / this->num_inliers;
+}
@@ -0,0 +1,134 @@
+#include <mir_handle_detection/organized_clustering.h>
+
+#include <algorithm>
+#include <limits>
+
+OrganizedClustering::OrganizedClustering() :
+    cluster_tolerance(0.02), min_cluster_size(1), max_cluster_size(std::numeric_limits<int>::max()),
+    pixel_radius(1)
+{
+}
+
+OrganizedClustering::~OrganizedClustering()
+{
+}
+
+void OrganizedClustering::setClusterTolerance(float cluster_tolerance)
+{
+    this->cluster_tolerance = cluster_tolerance;
+}
+
+void OrganizedClustering::setClusterSizeLimits(int min_cluster_size, int max_cluster_size)
+{
+    this->min_cluster_size = min_cluster_size;
+    this->max_cluster_size = max_cluster_size;
+}
+
+void OrganizedClustering::setPixelRadius(int pixel_radius)
+{
+    this->pixel_radius = std::max(pixel_radius, 1);
+}
+
+int OrganizedClustering::findRoot(int index)
+{
+    // path halving
+    while (this->parents[index] != index)
+    {
+        this->parents[index] = this->parents[this->parents[index]];
+        index = this->parents[index];
+    }
+    return index;
+}
+
+void OrganizedClustering::cluster(const pcl::PointCloud<pcl::PointXYZ> &cloud, const std::vector<int> &pixel_indices,
+                                  int width, int height, std::vector<pcl::PointIndices> &clusters)
+{
+    size_t num_points = cloud.points.size();
+    size_t num_pixels = static_cast<size_t>(width) * height;
+    if (this->pixel_to_point.size() != num_pixels)
+    {
+        this->pixel_to_point.assign(num_pixels, -1);
+    }
+
+    for (size_t i = 0; i < num_points; i++)
+    {
+        this->pixel_to_point[pixel_indices[i]] = i;
+    }
+    this->parents.resize(num_points);
+    for (size_t i = 0; i < num_points; i++)
+    {
+        this->parents[i] = i;
+    }
+
+    // every pair of neighbouring pixels is visited once, from the earlier pixel in row major order
+    float squared_tolerance = this->cluster_tolerance * this->cluster_tolerance;
+    for (size_t i = 0; i < num_points; i++)
+    {
+        int row = pixel_indices[i] / width;
+        int column = pixel_indices[i] % width;
+        const pcl::PointXYZ &point = cloud.points[i];
+
+        for (int dy = 0; dy <= this->pixel_radius && row + dy < height; dy++)
+        {
+            for (int dx = -this->pixel_radius; dx <= this->pixel_radius; dx++)
+            {
+                if ((dy == 0 && dx <= 0) || column + dx < 0 || column + dx >= width)
+                {
+                    continue;
+                }
+
+                int neighbour = this->pixel_to_point[(row + dy) * width + column + dx];
+                if (neighbour < 0)
+                {
+                    continue;
+                }
+
+                const pcl::PointXYZ &neighbour_point = cloud.points[neighbour];
+                float delta_x = point.x - neighbour_point.x;
+                float delta_y = point.y - neighbour_point.y;
+                float delta_z = point.z - neighbour_point.z;
+                if (delta_x * delta_x + delta_y * delta_y + delta_z * delta_z > squared_tolerance)
+                {
+                    continue;
+                }
+
+                int root = this->findRoot(i);
+                int neighbour_root = this->findRoot(neighbour);
+                if (root != neighbour_root)
+                {
+                    this->parents[std::max(root, neighbour_root)] = std::min(root, neighbour_root);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_points; i++)
+    {
+        this->pixel_to_point[pixel_indices[i]] = -1;
+    }
+
+    clusters.clear();
+    this->root_to_cluster.assign(num_points, -1);
+    for (size_t i = 0; i < num_points; i++)
+    {
+        int root = this->findRoot(i);
+        if (this->root_to_cluster[root] < 0)
+        {
+            this->root_to_cluster[root] = clusters.size();
+            clusters.push_back(pcl::PointIndices());
+        }
+        clusters[this->root_to_cluster[root]].indices.push_back(i);
+    }
+
+    size_t num_kept = 0;
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+        int cluster_size = clusters[i].indices.size();
+        if (cluster_size >= this->min_cluster_size && cluster_size <= this->max_cluster_size)
+        {
+            clusters[num_kept].indices.swap(clusters[i].indices);
+            num_kept++;
+        }
+    }
+    clusters.resize(num_kept);
+}
@@ -0,0 +1,310 @@
+#include <mir_handle_detection/perception_pipeline.h>
+#include <mir_handle_detection/pipeline_stages.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+PipelineBuffers::PipelineBuffers()
+{
+}
+
+PipelineBuffers::~PipelineBuffers()
+{
+}
+
+void PipelineBuffers::setKind(const std::string &name, const std::string &kind)
+{
+    std::pair<std::map<std::string, std::string>::iterator, bool> result =
+        this->kinds.insert(std::make_pair(name, kind));
+    if (!result.second && result.first->second != kind)
+    {
+        throw std::invalid_argument("buffer " + name + " is used as " + result.first->second + " and as " + kind);
+    }
+}
+
+PCloudT::Ptr PipelineBuffers::getCloud(const std::string &name)
+{
+    this->setKind(name, "cloud");
+    PCloudT::Ptr &cloud = this->clouds[name];
+    if (!cloud)
+    {
+        cloud.reset(new PCloudT);
+    }
+    return cloud;
+}
+
+pcl::PointIndices::Ptr PipelineBuffers::getIndices(const std::string &name)
+{
+    this->setKind(name, "indices");
+    pcl::PointIndices::Ptr &indices = this->indices[name];
+    if (!indices)
+    {
+        indices.reset(new pcl::PointIndices);
+    }
+    return indices;
+}
+
+pcl::ModelCoefficients::Ptr PipelineBuffers::getCoefficients(const std::string &name)
+{
+    this->setKind(name, "coefficients");
+    pcl::ModelCoefficients::Ptr &coefficients = this->coefficients[name];
+    if (!coefficients)
+    {
+        coefficients.reset(new pcl::ModelCoefficients);
+    }
+    return coefficients;
+}
+
+std::vector<pcl::PointIndices> &PipelineBuffers::getClusters(const std::string &name)
+{
+    this->setKind(name, "clusters");
+    return this->clusters[name];
+}
+
+Eigen::Affine3f &PipelineBuffers::getPose(const std::string &name)
+{
+    this->setKind(name, "pose");
+    return this->poses.insert(std::make_pair(name, Eigen::Affine3f::Identity())).first->second;
+}
+
+void PipelineBuffers::reserve(size_t num_points)
+{
+    for (std::map<std::string, PCloudT::Ptr>::iterator it = this->clouds.begin(); it != this->clouds.end(); ++it)
+    {
+        it->second->points.reserve(num_points);
+    }
+    for (std::map<std::string, pcl::PointIndices::Ptr>::iterator it = this->indices.begin();
+         it != this->indices.end(); ++it)
+    {
+        it->second->indices.reserve(num_points);
+    }
+}
+
+void PipelineBuffers::clear()
+{
+    this->kinds.clear();
+    this->clouds.clear();
+    this->indices.clear();
+    this->coefficients.clear();
+    this->clusters.clear();
+    this->poses.clear();
+}
+
+void StageConfig::checkBufferCount(size_t min_inputs, size_t max_inputs, size_t min_outputs,
+                                   size_t max_outputs) const
+{
+    if (this->inputs.size() < min_inputs || this->inputs.size() > max_inputs ||
+        this->outputs.size() < min_outputs || this->outputs.size() > max_outputs)
+    {
+        throw std::invalid_argument("stage " + this->name + " of type " + this->type +
+                                    " has the wrong number of inputs or outputs");
+    }
+}
+
+Eigen::Vector3f getVector3Parameter(const YAML::Node &node, const std::string &key,
+                                    const Eigen::Vector3f &default_value)
+{
+    if (!node[key])
+    {
+        return default_value;
+    }
+    if (node[key].IsScalar())
+    {
+        return Eigen::Vector3f::Constant(node[key].as<float>());
+    }
+    std::vector<float> values = node[key].as<std::vector<float> >();
+    if (values.size() != 3)
+    {
+        throw std::invalid_argument(key + " needs three values");
+    }
+    return Eigen::Vector3f(values[0], values[1], values[2]);
+}
+
+PipelineStage::PipelineStage()
+{
+}
+
+PipelineStage::~PipelineStage()
+{
+}
+
+void PipelineStage::reset()
+{
+}
+
+PerceptionPipeline::PerceptionPipeline() : milliseconds(0.0)
+{
+}
+
+PerceptionPipeline::~PerceptionPipeline()
+{
+}
+
+void PerceptionPipeline::load(const YAML::Node &config)
+{
+    try
+    {
+        this->loadStages(config);
+    }
+    catch (...)
+    {
+        // do not keep a partial pipeline
+        this->stages.clear();
+        this->levels.clear();
+        this->producers.clear();
+        this->buffers.clear();
+        this->timings.clear();
+        this->results.clear();
+        throw;
+    }
+}
+
+void PerceptionPipeline::loadStages(const YAML::Node &config)
+{
+    this->stages.clear();
+    this->levels.clear();
+    this->producers.clear();
+    this->buffers.clear();
+    this->timings.clear();
+
+    YAML::Node stage_configs = config["stages"];
+    if (!stage_configs || !stage_configs.IsSequence() || stage_configs.size() == 0)
+    {
+        throw std::invalid_argument("the pipeline has no stages");
+    }
+
+    for (size_t i = 0; i < stage_configs.size(); i++)
+    {
+        StageConfig stage_config;
+        stage_config.node = stage_configs[i];
+        stage_config.type = getParameter<std::string>(stage_config.node, "type", "");
+        stage_config.name = getParameter<std::string>(stage_config.node, "name", stage_config.type);
+        stage_config.inputs = getParameter<std::vector<std::string> >(stage_config.node, "inputs",
+                                                                      std::vector<std::string>());
+        stage_config.outputs = getParameter<std::vector<std::string> >(stage_config.node, "outputs",
+                                                                       std::vector<std::string>());
+
+        // a stage runs after the latest stage it depends on
+        int level = 0;
+        for (size_t j = 0; j < stage_config.inputs.size(); j++)
+        {
+            std::map<std::string, size_t>::const_iterator producer = this->producers.find(stage_config.inputs[j]);
+            if (producer == this->producers.end())
+            {
+                throw std::invalid_argument("input " + stage_config.inputs[j] + " of stage " + stage_config.name +
+                                            " is not the output of an earlier stage");
+            }
+            level = std::max(level, this->timings[producer->second].level + 1);
+        }
+        for (size_t j = 0; j < stage_config.outputs.size(); j++)
+        {
+            if (this->producers.count(stage_config.outputs[j]) > 0)
+            {
+                throw std::invalid_argument("output " + stage_config.outputs[j] + " of stage " + stage_config.name +
+                                            " is already written by another stage");
+            }
+            this->producers[stage_config.outputs[j]] = i;
+        }
+
+        boost::shared_ptr<PipelineStage> stage = createPipelineStage(stage_config.type);
+        stage->configure(stage_config, this->buffers);
+        this->stages.push_back(stage);
+
+        if (level >= static_cast<int>(this->levels.size()))
+        {
+            this->levels.resize(level + 1);
+        }
+        this->levels[level].push_back(i);
+
+        StageTiming timing;
+        timing.name = stage_config.name;
+        timing.type = stage_config.type;
+        timing.level = level;
+        timing.has_run = false;
+        timing.milliseconds = 0.0;
+        this->timings.push_back(timing);
+    }
+
+    this->buffers.reserve(getParameter<size_t>(config, "max_points", 0));
+    this->results.assign(this->stages.size(), 0);
+}
+
+void PerceptionPipeline::loadFile(const std::string &filename)
+{
+    this->load(YAML::LoadFile(filename));
+}
+
+void PerceptionPipeline::runStage(size_t index, const PipelineInput &input)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    this->results[index] = this->stages[index]->process(input);
+    this->timings[index].milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    this->timings[index].has_run = true;
+}
+
+bool PerceptionPipeline::process(const PipelineInput &input)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < this->timings.size(); i++)
+    {
+        this->timings[i].has_run = false;
+        this->timings[i].milliseconds = 0.0;
+    }
+
+    bool success = !this->stages.empty();
+    for (size_t level = 0; level < this->levels.size() && success; level++)
+    {
+        // every stage writes only its own buffers and timing, the first one runs on this thread
+        const std::vector<size_t> &level_stages = this->levels[level];
+        this->threads.clear();
+        for (size_t i = 1; i < level_stages.size(); i++)
+        {
+            this->threads.push_back(std::thread(&PerceptionPipeline::runStage, this, level_stages[i],
+                                                std::cref(input)));
+        }
+        this->runStage(level_stages[0], input);
+        for (size_t i = 0; i < this->threads.size(); i++)
+        {
+            this->threads[i].join();
+        }
+
+        for (size_t i = 0; i < level_stages.size(); i++)
+        {
+            success = success && this->results[level_stages[i]];
+        }
+    }
+
+    this->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return success;
+}
+
+void PerceptionPipeline::reset()
+{
+    for (size_t i = 0; i < this->stages.size(); i++)
+    {
+        this->stages[i]->reset();
+    }
+}
+
+bool PerceptionPipeline::hasOutput(const std::string &name) const
+{
+    return this->producers.count(name) > 0;
+}
+
+PipelineBuffers &PerceptionPipeline::getBuffers()
+{
+    return this->buffers;
+}
+
+const std::vector<PerceptionPipeline::StageTiming> &PerceptionPipeline::getTimings() const
+{
+    return this->timings;
+}
+
+double PerceptionPipeline::getMilliseconds() const
+{
+    return this->milliseconds;
+}
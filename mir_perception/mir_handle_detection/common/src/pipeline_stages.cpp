@@ -0,0 +1,377 @@
+#include <mir_handle_detection/pipeline_stages.h>
+
+#include <limits>
+#include <stdexcept>
+
+#include <pcl/common/centroid.h>
+
+boost::shared_ptr<PipelineStage> createPipelineStage(const std::string &type)
+{
+    if (type == "crop_voxel")
+    {
+        return boost::shared_ptr<PipelineStage>(new CropVoxelStage);
+    }
+    if (type == "passthrough")
+    {
+        return boost::shared_ptr<PipelineStage>(new PassThroughStage);
+    }
+    if (type == "voxel_grid")
+    {
+        return boost::shared_ptr<PipelineStage>(new VoxelGridStage);
+    }
+    if (type == "plane_ransac")
+    {
+        return boost::shared_ptr<PipelineStage>(new PlaneRansacStage);
+    }
+    if (type == "project_inliers")
+    {
+        return boost::shared_ptr<PipelineStage>(new ProjectInliersStage);
+    }
+    if (type == "convex_hull")
+    {
+        return boost::shared_ptr<PipelineStage>(new ConvexHullStage);
+    }
+    if (type == "polygonal_prism")
+    {
+        return boost::shared_ptr<PipelineStage>(new PolygonalPrismStage);
+    }
+    if (type == "extract_indices")
+    {
+        return boost::shared_ptr<PipelineStage>(new ExtractIndicesStage);
+    }
+    if (type == "euclidean_clustering")
+    {
+        return boost::shared_ptr<PipelineStage>(new EuclideanClusteringStage);
+    }
+    if (type == "organized_clustering")
+    {
+        return boost::shared_ptr<PipelineStage>(new OrganizedClusteringStage);
+    }
+    if (type == "closest_cluster")
+    {
+        return boost::shared_ptr<PipelineStage>(new ClosestClusterStage);
+    }
+    if (type == "handle_fit")
+    {
+        return boost::shared_ptr<PipelineStage>(new HandleFitStage);
+    }
+    throw std::invalid_argument("unknown stage type '" + type + "'");
+}
+
+void CropVoxelStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(0, 0, 2, 3);
+    this->crop_voxel_filter.setCropBox(getParameter<float>(config.node, "y_min", -1.0),
+                                       getParameter<float>(config.node, "y_max", 1.0),
+                                       getParameter<float>(config.node, "z_min", -1.0),
+                                       getParameter<float>(config.node, "z_max", 1.0));
+    Eigen::Vector3f leaf_size = getVector3Parameter(config.node, "leaf_size", Eigen::Vector3f::Constant(0.01));
+    this->crop_voxel_filter.setLeafSize(leaf_size[0], leaf_size[1], leaf_size[2]);
+
+    this->cropped = buffers.getCloud(config.outputs[0]);
+    this->voxelized = buffers.getCloud(config.outputs[1]);
+    if (config.outputs.size() > 2)
+    {
+        this->pixel_indices = buffers.getIndices(config.outputs[2]);
+    }
+}
+
+bool CropVoxelStage::process(const PipelineInput &input)
+{
+    this->crop_voxel_filter.setTransform(input.transform);
+    this->crop_voxel_filter.filter(input.data, static_cast<size_t>(input.width) * input.height, input.point_step,
+                                   input.xyz_offset, *this->cropped, *this->voxelized);
+    if (this->pixel_indices)
+    {
+        // assignment keeps the capacity of the buffer
+        this->pixel_indices->indices = this->crop_voxel_filter.getCroppedIndices();
+    }
+    return !this->voxelized->points.empty();
+}
+
+void PassThroughStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(1, 1, 1, 1);
+    this->passthrough.setFilterFieldName(getParameter<std::string>(config.node, "field_name", "z"));
+    this->passthrough.setFilterLimits(getParameter<float>(config.node, "limit_min", -1.0),
+                                      getParameter<float>(config.node, "limit_max", 1.0));
+    this->passthrough.setFilterLimitsNegative(getParameter<bool>(config.node, "negative", false));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->output_cloud = buffers.getCloud(config.outputs[0]);
+}
+
+bool PassThroughStage::process(const PipelineInput &input)
+{
+    this->passthrough.setInputCloud(this->input_cloud);
+    this->passthrough.filter(*this->output_cloud);
+    return !this->output_cloud->points.empty();
+}
+
+void VoxelGridStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(1, 1, 1, 1);
+    Eigen::Vector3f leaf_size = getVector3Parameter(config.node, "leaf_size", Eigen::Vector3f::Constant(0.01));
+    this->voxel_grid.setLeafSize(leaf_size[0], leaf_size[1], leaf_size[2]);
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->output_cloud = buffers.getCloud(config.outputs[0]);
+}
+
+bool VoxelGridStage::process(const PipelineInput &input)
+{
+    this->voxel_grid.setInputCloud(this->input_cloud);
+    this->voxel_grid.filter(*this->output_cloud);
+    return !this->output_cloud->points.empty();
+}
+
+void PlaneRansacStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(1, 1, 2, 2);
+    this->plane_ransac.setDistanceThreshold(getParameter<float>(config.node, "distance_threshold", 0.01));
+    this->plane_ransac.setAxis(getVector3Parameter(config.node, "axis", Eigen::Vector3f(1.0, 0.0, 0.0)),
+                               getParameter<float>(config.node, "eps_angle", 0.0));
+    this->plane_ransac.setMaxIterations(getParameter<int>(config.node, "max_iterations", 1000),
+                                        getParameter<double>(config.node, "probability", 0.99));
+    this->plane_ransac.setNumThreads(getParameter<int>(config.node, "num_threads", 0));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->inliers = buffers.getIndices(config.outputs[0]);
+    this->coefficients = buffers.getCoefficients(config.outputs[1]);
+}
+
+bool PlaneRansacStage::process(const PipelineInput &input)
+{
+    return this->plane_ransac.segment(*this->input_cloud, *this->inliers, *this->coefficients);
+}
+
+void PlaneRansacStage::reset()
+{
+    this->plane_ransac.clearPreviousPlane();
+}
+
+void ProjectInliersStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(3, 3, 1, 1);
+    this->project_inliers.setModelType(pcl::SACMODEL_NORMAL_PARALLEL_PLANE);
+    this->project_inliers.setCopyAllData(false);
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->indices = buffers.getIndices(config.inputs[1]);
+    this->coefficients = buffers.getCoefficients(config.inputs[2]);
+    this->output_cloud = buffers.getCloud(config.outputs[0]);
+}
+
+bool ProjectInliersStage::process(const PipelineInput &input)
+{
+    this->project_inliers.setInputCloud(this->input_cloud);
+    this->project_inliers.setModelCoefficients(this->coefficients);
+    this->project_inliers.setIndices(this->indices);
+    this->project_inliers.filter(*this->output_cloud);
+    return !this->output_cloud->points.empty();
+}
+
+void ConvexHullStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(1, 1, 1, 1);
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->hull = buffers.getCloud(config.outputs[0]);
+}
+
+bool ConvexHullStage::process(const PipelineInput &input)
+{
+    this->convex_hull.setInputCloud(this->input_cloud);
+    this->convex_hull.reconstruct(*this->hull);
+    return !this->hull->points.empty();
+}
+
+void PolygonalPrismStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(2, 2, 1, 1);
+    this->extract_polygonal_prism.setHeightLimits(getParameter<float>(config.node, "height_min", 0.0),
+                                                  getParameter<float>(config.node, "height_max", 0.1));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->hull = buffers.getCloud(config.inputs[1]);
+    this->indices = buffers.getIndices(config.outputs[0]);
+}
+
+bool PolygonalPrismStage::process(const PipelineInput &input)
+{
+    this->extract_polygonal_prism.setInputPlanarHull(this->hull);
+    this->extract_polygonal_prism.setInputCloud(this->input_cloud);
+    this->extract_polygonal_prism.segment(*this->indices);
+    return !this->indices->indices.empty();
+}
+
+void ExtractIndicesStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(2, 2, 1, 1);
+    this->extract_indices.setNegative(getParameter<bool>(config.node, "negative", false));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->indices = buffers.getIndices(config.inputs[1]);
+    this->output_cloud = buffers.getCloud(config.outputs[0]);
+}
+
+bool ExtractIndicesStage::process(const PipelineInput &input)
+{
+    this->extract_indices.setInputCloud(this->input_cloud);
+    this->extract_indices.setIndices(this->indices);
+    this->extract_indices.filter(*this->output_cloud);
+    return !this->output_cloud->points.empty();
+}
+
+EuclideanClusteringStage::EuclideanClusteringStage() :
+    tree(new pcl::search::KdTree<pcl::PointXYZ>), clusters(NULL)
+{
+    this->euclidean_cluster_extraction.setSearchMethod(this->tree);
+}
+
+void EuclideanClusteringStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(1, 1, 1, 1);
+    this->euclidean_cluster_extraction.setClusterTolerance(getParameter<float>(config.node, "cluster_tolerance",
+                                                                               0.02));
+    this->euclidean_cluster_extraction.setMinClusterSize(getParameter<int>(config.node, "min_cluster_size", 1));
+    this->euclidean_cluster_extraction.setMaxClusterSize(getParameter<int>(config.node, "max_cluster_size",
+                                                                           std::numeric_limits<int>::max()));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->clusters = &buffers.getClusters(config.outputs[0]);
+}
+
+bool EuclideanClusteringStage::process(const PipelineInput &input)
+{
+    // the inner index vectors are dropped by clear, only the outer one keeps its capacity
+    this->clusters->clear();
+    this->euclidean_cluster_extraction.setInputCloud(this->input_cloud);
+    this->euclidean_cluster_extraction.extract(*this->clusters);
+    return !this->clusters->empty();
+}
+
+OrganizedClusteringStage::OrganizedClusteringStage() :
+    tree(new pcl::search::KdTree<pcl::PointXYZ>), clusters(NULL)
+{
+    this->euclidean_cluster_extraction.setSearchMethod(this->tree);
+}
+
+void OrganizedClusteringStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(3, 3, 1, 1);
+    float cluster_tolerance = getParameter<float>(config.node, "cluster_tolerance", 0.02);
+    int min_cluster_size = getParameter<int>(config.node, "min_cluster_size", 1);
+    int max_cluster_size = getParameter<int>(config.node, "max_cluster_size", std::numeric_limits<int>::max());
+    this->organized_clustering.setClusterTolerance(cluster_tolerance);
+    this->organized_clustering.setClusterSizeLimits(min_cluster_size, max_cluster_size);
+    this->organized_clustering.setPixelRadius(getParameter<int>(config.node, "pixel_radius", 1));
+    this->euclidean_cluster_extraction.setClusterTolerance(cluster_tolerance);
+    this->euclidean_cluster_extraction.setMinClusterSize(min_cluster_size);
+    this->euclidean_cluster_extraction.setMaxClusterSize(max_cluster_size);
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->cropped_indices = buffers.getIndices(config.inputs[1]);
+    this->cropped_pixel_indices = buffers.getIndices(config.inputs[2]);
+    this->clusters = &buffers.getClusters(config.outputs[0]);
+}
+
+bool OrganizedClusteringStage::process(const PipelineInput &input)
+{
+    this->clusters->clear();
+    if (input.height > 1)
+    {
+        const std::vector<int> &cropped_indices = this->cropped_indices->indices;
+        const std::vector<int> &cropped_pixel_indices = this->cropped_pixel_indices->indices;
+        this->pixel_indices.resize(cropped_indices.size());
+        for (size_t i = 0; i < cropped_indices.size(); i++)
+        {
+            this->pixel_indices[i] = cropped_pixel_indices[cropped_indices[i]];
+        }
+        this->organized_clustering.cluster(*this->input_cloud, this->pixel_indices, input.width, input.height,
+                                           *this->clusters);
+    }
+    else
+    {
+        this->euclidean_cluster_extraction.setInputCloud(this->input_cloud);
+        this->euclidean_cluster_extraction.extract(*this->clusters);
+    }
+    return !this->clusters->empty();
+}
+
+ClosestClusterStage::ClosestClusterStage() : clusters(NULL), pose(NULL)
+{
+}
+
+void ClosestClusterStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(2, 2, 1, 1);
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->clusters = &buffers.getClusters(config.inputs[1]);
+    this->pose = &buffers.getPose(config.outputs[0]);
+}
+
+bool ClosestClusterStage::process(const PipelineInput &input)
+{
+    if (this->clusters->empty())
+    {
+        return false;
+    }
+
+    float closest_dist = std::numeric_limits<float>::max();
+    Eigen::Vector4f closest_centroid(0.0, 0.0, 0.0, 0.0);
+    for (size_t i = 0; i < this->clusters->size(); i++)
+    {
+        Eigen::Vector4f centroid;
+        pcl::compute3DCentroid(*this->input_cloud, (*this->clusters)[i], centroid);
+        float dist = centroid.head<3>().norm();
+        if (dist < closest_dist)
+        {
+            closest_dist = dist;
+            closest_centroid = centroid;
+        }
+    }
+    *this->pose = Eigen::Translation3f(closest_centroid.head<3>()) * Eigen::Quaternionf::Identity();
+    return true;
+}
+
+HandleFitStage::HandleFitStage() : pose(NULL)
+{
+}
+
+void HandleFitStage::configure(const StageConfig &config, PipelineBuffers &buffers)
+{
+    config.checkBufferCount(2, 2, 1, 2);
+    this->handle_bar_fit.setDistanceThreshold(getParameter<float>(config.node, "distance_threshold", 0.02));
+    this->handle_bar_fit.setEpsAngle(getParameter<float>(config.node, "eps_angle", 0.2));
+    this->handle_bar_fit.setMaxIterations(getParameter<int>(config.node, "max_iterations", 200),
+                                          getParameter<double>(config.node, "probability", 0.99));
+    this->handle_bar_fit.setMinInliers(getParameter<int>(config.node, "min_inliers", 10));
+    this->handle_bar_fit.setRadiusLimits(getParameter<float>(config.node, "radius_min", 0.0),
+                                         getParameter<float>(config.node, "radius_max", 0.015));
+    this->handle_bar_fit.setLengthLimits(getParameter<float>(config.node, "length_min", 0.03),
+                                         getParameter<float>(config.node, "length_max", 0.6));
+
+    this->input_cloud = buffers.getCloud(config.inputs[0]);
+    this->coefficients = buffers.getCoefficients(config.inputs[1]);
+    this->pose = &buffers.getPose(config.outputs[0]);
+    if (config.outputs.size() > 1)
+    {
+        this->inliers = buffers.getIndices(config.outputs[1]);
+    }
+}
+
+bool HandleFitStage::process(const PipelineInput &input)
+{
+    if (this->coefficients->values.size() != 4)
+    {
+        return false;
+    }
+    Eigen::Vector4f plane(this->coefficients->values[0], this->coefficients->values[1],
+                          this->coefficients->values[2], this->coefficients->values[3]);
+    bool success = this->handle_bar_fit.fit(*this->input_cloud, plane, *this->pose);
+    if (this->inliers)
+    {
+        this->inliers->indices = this->handle_bar_fit.getInliers();
+    }
+    return success;
+}
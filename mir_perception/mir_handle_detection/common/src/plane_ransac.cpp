@@ -0,0 +1,268 @@
+#include <mir_handle_detection/plane_ransac.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <thread>
+
+#include <Eigen/Eigenvalues>
+#include <Eigen/Geometry>
+
+namespace
+{
+/**
+ * Number of points after which scoring checks whether the hypothesis can still win
+ */
+const size_t EARLY_TERMINATION_STEP = 64;
+}
+
+PlaneRansac::PlaneRansac() :
+    distance_threshold(0.01), axis(1.0, 0.0, 0.0), eps_angle(0.0), max_iterations(50), probability(0.99),
+    num_threads(0), has_previous_plane(false), previous_plane(Eigen::Vector4f::Zero()), num_calls(0),
+    cloud(NULL), seed_plane(Eigen::Vector4f::Zero()), seed_inlier_count(0)
+{
+}
+
+PlaneRansac::~PlaneRansac()
+{
+}
+
+void PlaneRansac::setDistanceThreshold(float distance_threshold)
+{
+    this->distance_threshold = distance_threshold;
+}
+
+void PlaneRansac::setAxis(const Eigen::Vector3f &axis, float eps_angle)
+{
+    this->axis = axis.normalized();
+    this->eps_angle = eps_angle;
+}
+
+void PlaneRansac::setMaxIterations(int max_iterations, double probability)
+{
+    this->max_iterations = std::max(max_iterations, 1);
+    this->probability = probability;
+}
+
+void PlaneRansac::setNumThreads(int num_threads)
+{
+    this->num_threads = num_threads;
+}
+
+void PlaneRansac::clearPreviousPlane()
+{
+    this->has_previous_plane = false;
+}
+
+bool PlaneRansac::segment(const pcl::PointCloud<pcl::PointXYZ> &cloud, pcl::PointIndices &inliers,
+                          pcl::ModelCoefficients &coefficients)
+{
+    inliers.indices.clear();
+    coefficients.values.clear();
+    if (cloud.points.size() < 3)
+    {
+        return false;
+    }
+
+    this->cloud = &cloud;
+    this->seed_inlier_count = 0;
+    this->seed_plane = Eigen::Vector4f::Zero();
+    if (this->has_previous_plane && this->isValid(this->previous_plane))
+    {
+        this->seed_inlier_count = this->countInliers(this->previous_plane, 0);
+        this->seed_plane = this->previous_plane;
+    }
+
+    int num_threads = this->num_threads > 0 ? this->num_threads : std::thread::hardware_concurrency();
+    num_threads = std::max(std::min(num_threads, this->max_iterations), 1);
+    this->thread_planes.resize(num_threads);
+    this->thread_inlier_counts.resize(num_threads);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; i++)
+    {
+        threads.push_back(std::thread(&PlaneRansac::scoreHypotheses, this, i, num_threads));
+    }
+    this->scoreHypotheses(0, num_threads);
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    this->num_calls++;
+
+    // the first thread wins ties, so the choice does not depend on which thread finished first
+    int best_thread = 0;
+    for (int i = 1; i < num_threads; i++)
+    {
+        if (this->thread_inlier_counts[i] > this->thread_inlier_counts[best_thread])
+        {
+            best_thread = i;
+        }
+    }
+    const Eigen::Vector4f best_plane = this->thread_planes[best_thread];
+    if (this->thread_inlier_counts[best_thread] < 3)
+    {
+        return false;
+    }
+
+    this->collectInliers(best_plane, inliers.indices);
+    Eigen::Vector4f plane = this->refinePlane(best_plane, inliers.indices);
+    if (this->isValid(plane))
+    {
+        this->collectInliers(plane, inliers.indices);
+    }
+    else
+    {
+        plane = best_plane;
+    }
+
+    this->previous_plane = plane;
+    this->has_previous_plane = true;
+    coefficients.values.assign(plane.data(), plane.data() + 4);
+    return true;
+}
+
+void PlaneRansac::scoreHypotheses(int thread_index, int num_threads)
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = this->cloud->points;
+    // different samples on every thread and in every call, but reproducible for a fixed number of threads
+    std::mt19937 generator(this->num_calls * 1024 + thread_index);
+    std::uniform_int_distribution<int> distribution(0, points.size() - 1);
+
+    Eigen::Vector4f best_plane = this->seed_plane;
+    int best_inlier_count = this->seed_inlier_count;
+    // every thread scores its share of the iterations required for its best plane
+    int required_iterations = (this->computeRequiredIterations(best_inlier_count) + num_threads - 1) / num_threads;
+    for (int iteration = 0; iteration < required_iterations; iteration++)
+    {
+        int index_0 = distribution(generator);
+        int index_1 = distribution(generator);
+        int index_2 = distribution(generator);
+        if (index_0 == index_1 || index_0 == index_2 || index_1 == index_2)
+        {
+            continue;
+        }
+
+        Eigen::Vector3f p0 = points[index_0].getVector3fMap();
+        Eigen::Vector3f normal = (points[index_1].getVector3fMap() - p0).cross(points[index_2].getVector3fMap() - p0);
+        float norm = normal.norm();
+        if (norm < std::numeric_limits<float>::epsilon())
+        {
+            continue;
+        }
+        normal /= norm;
+
+        Eigen::Vector4f plane(normal[0], normal[1], normal[2], -normal.dot(p0));
+        if (!this->isValid(plane))
+        {
+            continue;
+        }
+
+        int inlier_count = this->countInliers(plane, best_inlier_count);
+        if (inlier_count > best_inlier_count)
+        {
+            best_inlier_count = inlier_count;
+            best_plane = plane;
+            required_iterations = (this->computeRequiredIterations(inlier_count) + num_threads - 1) / num_threads;
+        }
+    }
+
+    this->thread_planes[thread_index] = best_plane;
+    this->thread_inlier_counts[thread_index] = best_inlier_count;
+}
+
+int PlaneRansac::countInliers(const Eigen::Vector4f &plane, int count_to_beat) const
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = this->cloud->points;
+    size_t num_points = points.size();
+    int count = 0;
+
+    for (size_t start = 0; start < num_points; start += EARLY_TERMINATION_STEP)
+    {
+        if (count + static_cast<int>(num_points - start) <= count_to_beat)
+        {
+            return count;
+        }
+
+        size_t end = std::min(start + EARLY_TERMINATION_STEP, num_points);
+        for (size_t i = start; i < end; i++)
+        {
+            const pcl::PointXYZ &point = points[i];
+            float distance = plane[0] * point.x + plane[1] * point.y + plane[2] * point.z + plane[3];
+            count += (std::fabs(distance) <= this->distance_threshold);
+        }
+    }
+    return count;
+}
+
+int PlaneRansac::computeRequiredIterations(int inlier_count) const
+{
+    if (inlier_count < 3)
+    {
+        return this->max_iterations;
+    }
+
+    // probability that a sample of three points contains an outlier
+    double inlier_ratio = static_cast<double>(inlier_count) / this->cloud->points.size();
+    double outlier_sample_probability = 1.0 - inlier_ratio * inlier_ratio * inlier_ratio;
+    outlier_sample_probability = std::max(outlier_sample_probability, std::numeric_limits<double>::epsilon());
+    outlier_sample_probability = std::min(outlier_sample_probability, 1.0 - std::numeric_limits<double>::epsilon());
+
+    double iterations = std::ceil(std::log(1.0 - this->probability) / std::log(outlier_sample_probability));
+    return static_cast<int>(std::min(iterations, static_cast<double>(this->max_iterations)));
+}
+
+bool PlaneRansac::isValid(const Eigen::Vector4f &plane) const
+{
+    if (this->eps_angle <= 0.0)
+    {
+        return true;
+    }
+
+    float cos_angle = std::fabs(plane.head<3>().dot(this->axis));
+    return std::acos(std::min(cos_angle, 1.0f)) <= this->eps_angle;
+}
+
+Eigen::Vector4f PlaneRansac::refinePlane(const Eigen::Vector4f &plane, const std::vector<int> &indices) const
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = this->cloud->points;
+
+    Eigen::Vector3f centroid = Eigen::Vector3f::Zero();
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        centroid += points[indices[i]].getVector3fMap();
+    }
+    centroid /= indices.size();
+
+    Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        Eigen::Vector3f delta = points[indices[i]].getVector3fMap() - centroid;
+        covariance += delta * delta.transpose();
+    }
+
+    // the normal is the direction of least variance, eigenvalues are sorted in increasing order
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver(covariance);
+    Eigen::Vector3f normal = solver.eigenvectors().col(0);
+    if (normal.dot(plane.head<3>()) < 0.0)
+    {
+        normal = -normal;
+    }
+    return Eigen::Vector4f(normal[0], normal[1], normal[2], -normal.dot(centroid));
+}
+
+void PlaneRansac::collectInliers(const Eigen::Vector4f &plane, std::vector<int> &indices) const
+{
+    const pcl::PointCloud<pcl::PointXYZ>::VectorType &points = this->cloud->points;
+
+    indices.clear();
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        const pcl::PointXYZ &point = points[i];
+        float distance = plane[0] * point.x + plane[1] * point.y + plane[2] * point.z + plane[3];
+        if (std::fabs(distance) <= this->distance_threshold)
+        {
+            indices.push_back(i);
+        }
+    }
+}
@@ -0,0 +1,143 @@
+#include <mir_handle_detection/replay_statistics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+HandleLabel parseHandleLabel(const YAML::Node &node)
+{
+    HandleLabel label;
+    std::vector<float> position = node["position"].as<std::vector<float> >();
+    if (position.size() != 3)
+    {
+        throw YAML::RepresentationException(node.Mark(), "the handle position needs three values");
+    }
+    label.position = Eigen::Vector3f(position[0], position[1], position[2]);
+
+    label.has_axis = static_cast<bool>(node["axis"]);
+    label.axis = Eigen::Vector3f::Zero();
+    if (label.has_axis)
+    {
+        std::vector<float> axis = node["axis"].as<std::vector<float> >();
+        if (axis.size() != 3)
+        {
+            throw YAML::RepresentationException(node.Mark(), "the handle axis needs three values");
+        }
+        label.axis = Eigen::Vector3f(axis[0], axis[1], axis[2]).normalized();
+    }
+    return label;
+}
+
+ReplayStatistics::ReplayStatistics() :
+    num_frames(0), num_skipped(0), num_found(0), num_labelled(0), has_orientation(false)
+{
+}
+
+ReplayStatistics::~ReplayStatistics()
+{
+}
+
+void ReplayStatistics::addFrame(const DrawerHandleDetector &detector, bool is_found,
+                                const Eigen::Affine3f &handle_pose, const HandleLabel *label)
+{
+    this->num_frames++;
+    this->has_orientation = detector.hasOrientation();
+    this->frame_milliseconds.push_back(detector.getMilliseconds());
+
+    const std::vector<PerceptionPipeline::StageTiming> &timings = detector.getTimings();
+    if (this->stage_names.size() != timings.size())
+    {
+        this->stage_names.clear();
+        for (size_t i = 0; i < timings.size(); i++)
+        {
+            this->stage_names.push_back(timings[i].name);
+        }
+        this->stage_milliseconds.assign(timings.size(), std::vector<double>());
+    }
+    // stages after a failed one did not run and are left out of their percentiles
+    for (size_t i = 0; i < timings.size(); i++)
+    {
+        if (timings[i].has_run)
+        {
+            this->stage_milliseconds[i].push_back(timings[i].milliseconds);
+        }
+    }
+
+    if (is_found)
+    {
+        this->num_found++;
+    }
+    if (!label)
+    {
+        return;
+    }
+    this->num_labelled++;
+    if (!is_found)
+    {
+        return;
+    }
+    this->position_errors.push_back((handle_pose.translation() - label->position).norm() * 1000.0);
+    if (label->has_axis && this->has_orientation)
+    {
+        // the direction of the bar has no sign
+        float cos_angle = std::fabs(handle_pose.linear().col(1).dot(label->axis));
+        this->axis_errors.push_back(std::acos(std::min(cos_angle, 1.0f)) * 180.0 / M_PI);
+    }
+}
+
+void ReplayStatistics::addSkippedFrame()
+{
+    this->num_skipped++;
+}
+
+void ReplayStatistics::printPercentiles(FILE *stream, const std::string &name, std::vector<double> &values)
+{
+    if (values.empty())
+    {
+        fprintf(stream, "  %-24s %9s\n", name.c_str(), "-");
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    double mean = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+    fprintf(stream, "  %-24s %9.3f %9.3f %9.3f %9.3f %9.3f\n", name.c_str(), mean,
+            values[(values.size() - 1) * 50 / 100], values[(values.size() - 1) * 90 / 100],
+            values[(values.size() - 1) * 99 / 100], values.back());
+}
+
+void ReplayStatistics::print(FILE *stream) const
+{
+    fprintf(stream, "frames: %d processed, %d skipped, handle found in %d (%.1f %%)\n", this->num_frames,
+            this->num_skipped, this->num_found,
+            this->num_frames > 0 ? 100.0 * this->num_found / this->num_frames : 0.0);
+
+    double total_milliseconds = std::accumulate(this->frame_milliseconds.begin(), this->frame_milliseconds.end(),
+                                                0.0);
+    if (total_milliseconds > 0.0)
+    {
+        fprintf(stream, "throughput: %.1f frames/s\n", 1000.0 * this->num_frames / total_milliseconds);
+    }
+
+    fprintf(stream, "\n%-26s %9s %9s %9s %9s %9s\n", "latency [ms]", "mean", "p50", "p90", "p99", "max");
+    std::vector<double> values = this->frame_milliseconds;
+    printPercentiles(stream, "total", values);
+    for (size_t i = 0; i < this->stage_names.size(); i++)
+    {
+        values = this->stage_milliseconds[i];
+        printPercentiles(stream, this->stage_names[i], values);
+    }
+
+    if (this->num_labelled == 0)
+    {
+        return;
+    }
+    fprintf(stream, "\ndeviation from %d labels, %d not detected\n", this->num_labelled,
+            this->num_labelled - static_cast<int>(this->position_errors.size()));
+    fprintf(stream, "%-26s %9s %9s %9s %9s %9s\n", "", "mean", "p50", "p90", "p99", "max");
+    values = this->position_errors;
+    printPercentiles(stream, "position [mm]", values);
+    if (this->has_orientation)
+    {
+        values = this->axis_errors;
+        printPercentiles(stream, "axis [deg]", values);
+    }
+}
@@ -0,0 +1,360 @@
+/*
+ * Measures the per-frame cost, the cost of every pipeline stage and the heap
+ * allocations of the drawer handle detection on synthetic organized clouds of a
+ * drawer front with a bar handle.
+ *
+ * Allocations are counted at the malloc level of glibc, so they include the point
+ * buffers of the clouds and everything PCL allocates inside the stages. The first
+ * frame fills the buffers owned by the pipeline; after it, the allocations per frame
+ * should not depend on the size of the input cloud. For every pipeline the steady
+ * state allocations of the smallest and the largest cloud are compared, and the
+ * benchmark exits with 2 if they grow by more than ALLOCATION_TOLERANCE. Stages whose
+ * PCL implementation allocates in proportion to their input fail this check, e.g.
+ * euclidean_clustering on the dense segmented cloud rebuilds its FLANN index and all
+ * cluster index vectors every frame.
+ *
+ * Usage: drawer_handle_detector_benchmark [--iterations N] [--pipeline FILE]...
+ * Without --pipeline, all pipelines in ros/config are compared: the bar fit, the bar fit
+ * with a fine voxel grid running concurrently with the plane fit, and the clustering
+ * with a KD-tree and along the pixel grid.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <mir_handle_detection/drawer_handle_detector.h>
+
+/**
+ * Number and total size of heap allocations. They are counted in malloc, which replaces
+ * the glibc allocator for the whole process including PCL: Eigen::aligned_allocator,
+ * which holds the points of every pcl::PointCloud, allocates with std::malloc and would
+ * not be seen by a counter in operator new
+ */
+static std::atomic<size_t> num_allocations(0);
+static std::atomic<size_t> num_allocated_bytes(0);
+
+static void countAllocation(size_t size)
+{
+    num_allocations++;
+    num_allocated_bytes += size;
+}
+
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+
+void *malloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void **ptr, size_t alignment, size_t size) noexcept
+{
+    *ptr = memalign(alignment, size);
+    return *ptr || size == 0 ? 0 : ENOMEM;
+}
+
+void free(void *ptr) noexcept
+{
+    __libc_free(ptr);
+}
+}
+
+/**
+ * Every form of operator new and delete goes through the counting malloc and free
+ */
+void *operator new(size_t size)
+{
+    void *ptr = malloc(size == 0 ? 1 : size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+namespace
+{
+/**
+ * Relative growth of the steady state allocations per frame from the smallest to the
+ * largest cloud which is accepted, since the PCL stages allocate slightly differently
+ * for different views of the same scene
+ */
+const double ALLOCATION_TOLERANCE = 0.1;
+
+/**
+ * Memory layout of a pcl::PointXYZRGB as published by depth cameras
+ */
+struct CameraPoint
+{
+    float x;
+    float y;
+    float z;
+    float padding;
+    float rgb;
+    float padding_rgb[3];
+};
+
+/**
+ * Distance along the ray from origin in direction to the first surface of the scene,
+ * given in the base frame: a drawer front at x = 0.6 m with a bar handle along y
+ * 2.5 cm in front of it, and a wall at x = 1.5 m. Returns a negative value on a miss
+ */
+float castRay(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction)
+{
+    float closest = -1.0;
+
+    // handle: cylinder of radius 8 mm around the line x = 0.575, z = 0.03
+    const float handle_radius = 0.008;
+    Eigen::Vector2f origin_xz(origin[0] - 0.575, origin[2] - 0.03);
+    Eigen::Vector2f direction_xz(direction[0], direction[2]);
+    float a = direction_xz.squaredNorm();
+    float b = 2.0 * origin_xz.dot(direction_xz);
+    float c = origin_xz.squaredNorm() - handle_radius * handle_radius;
+    float discriminant = b * b - 4.0 * a * c;
+    if (discriminant >= 0.0 && a > 0.0)
+    {
+        float t = (-b - std::sqrt(discriminant)) / (2.0 * a);
+        float y = origin[1] + t * direction[1];
+        if (t > 0.0 && std::fabs(y) <= 0.06)
+        {
+            closest = t;
+        }
+    }
+
+    // drawer front and wall, planes of constant x with their extent in y and z
+    const float planes[2][5] = {{0.6, 0.25, -0.15, 0.15}, {1.5, 1.0, -0.5, 1.0}};
+    for (int i = 0; i < 2; i++)
+    {
+        if (std::fabs(direction[0]) < 1e-6)
+        {
+            continue;
+        }
+        float t = (planes[i][0] - origin[0]) / direction[0];
+        Eigen::Vector3f point = origin + t * direction;
+        if (t > 0.0 && std::fabs(point[1]) <= planes[i][1] && point[2] >= planes[i][2] &&
+            point[2] <= planes[i][3] && (closest < 0.0 || t < closest))
+        {
+            closest = t;
+        }
+    }
+    return closest;
+}
+
+/**
+ * Organized cloud of the scene seen by a pinhole camera with a 60 degree horizontal field
+ * of view at camera_pose, whose optical frame has z forward, x right and y down. Pixels
+ * without a surface are NaN as for a real depth camera
+ */
+void createScene(int width, int height, const Eigen::Affine3f &camera_pose, std::vector<CameraPoint> &points)
+{
+    float focal_length = 0.5 * width / std::tan(30.0 * M_PI / 180.0);
+
+    points.resize(width * height);
+    for (int row = 0; row < height; row++)
+    {
+        for (int column = 0; column < width; column++)
+        {
+            Eigen::Vector3f ray((column - 0.5 * width) / focal_length, (row - 0.5 * height) / focal_length, 1.0);
+            float t = castRay(camera_pose.translation(), camera_pose.linear() * ray);
+
+            CameraPoint &point = points[row * width + column];
+            memset(&point, 0, sizeof(CameraPoint));
+            point.x = t > 0.0 ? ray[0] * t : std::numeric_limits<float>::quiet_NaN();
+            point.y = t > 0.0 ? ray[1] * t : std::numeric_limits<float>::quiet_NaN();
+            point.z = t > 0.0 ? ray[2] * t : std::numeric_limits<float>::quiet_NaN();
+        }
+    }
+}
+
+/**
+ * Run the detection on a cloud of width x height points and print its timings. allocations
+ * and kbytes receive the allocations per frame after the first one
+ */
+void benchmarkCloudSize(DrawerHandleDetector &detector, int width, int height, int num_iterations,
+                        double &allocations, double &kbytes)
+{
+    // camera above the base, tilted down towards the drawer
+    Eigen::Matrix3f optical_to_base;
+    optical_to_base << 0.0, 0.0, 1.0,
+                       -1.0, 0.0, 0.0,
+                       0.0, -1.0, 0.0;
+    Eigen::Affine3f camera_pose = Eigen::Translation3f(0.1, 0.0, 0.3) *
+                                  Eigen::AngleAxisf(0.5, Eigen::Vector3f::UnitY()) * Eigen::Quaternionf(optical_to_base);
+    std::vector<CameraPoint> points;
+    createScene(width, height, camera_pose, points);
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(points.data());
+
+    Eigen::Affine3f handle_pose = Eigen::Affine3f::Identity();
+    size_t start_allocations = num_allocations;
+    size_t start_bytes = num_allocated_bytes;
+    bool is_found = detector.detect(data, width, height, sizeof(CameraPoint), 0, camera_pose, handle_pose);
+    size_t first_allocations = num_allocations - start_allocations;
+    size_t first_bytes = num_allocated_bytes - start_bytes;
+
+    std::vector<double> stage_ms(detector.getTimings().size(), 0.0);
+    start_allocations = num_allocations;
+    start_bytes = num_allocated_bytes;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_iterations; i++)
+    {
+        is_found = detector.detect(data, width, height, sizeof(CameraPoint), 0, camera_pose, handle_pose) && is_found;
+        const std::vector<PerceptionPipeline::StageTiming> &timings = detector.getTimings();
+        for (size_t j = 0; j < timings.size(); j++)
+        {
+            stage_ms[j] += timings[j].milliseconds;
+        }
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    allocations = static_cast<double>(num_allocations - start_allocations) / num_iterations;
+    kbytes = static_cast<double>(num_allocated_bytes - start_bytes) / num_iterations / 1024.0;
+
+    printf("%4dx%-4d %8.3f ms/frame | first frame %6zu allocs %9.1f KB | steady state %8.1f allocs/frame "
+           "%9.1f KB/frame | handle %s at (%.3f, %.3f, %.3f) along (%.3f, %.3f, %.3f)\n",
+           width, height, ms / num_iterations, first_allocations, first_bytes / 1024.0, allocations, kbytes,
+           is_found ? "found" : "not found", handle_pose.translation()[0], handle_pose.translation()[1],
+           handle_pose.translation()[2], handle_pose.linear()(0, 1), handle_pose.linear()(1, 1),
+           handle_pose.linear()(2, 1));
+
+    const std::vector<PerceptionPipeline::StageTiming> &timings = detector.getTimings();
+    for (size_t i = 0; i < timings.size(); i++)
+    {
+        printf("    level %d  %-20s %-22s %8.3f ms/frame\n", timings[i].level, timings[i].name.c_str(),
+               timings[i].type.c_str(), stage_ms[i] / num_iterations);
+    }
+}
+}
+
+int main(int argc, char **argv)
+{
+    int num_iterations = 50;
+    std::vector<std::string> pipeline_files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            num_iterations = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            pipeline_files.push_back(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--iterations N] [--pipeline FILE]...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (pipeline_files.empty())
+    {
+        pipeline_files.push_back(PIPELINE_CONFIG_DIR "/drawer_handle_pipeline.yaml");
+        pipeline_files.push_back(PIPELINE_CONFIG_DIR "/drawer_handle_parallel_pipeline.yaml");
+        pipeline_files.push_back(PIPELINE_CONFIG_DIR "/drawer_handle_cluster_pipeline.yaml");
+        pipeline_files.push_back(PIPELINE_CONFIG_DIR "/drawer_handle_organized_pipeline.yaml");
+    }
+
+    // growing sizes up to about 300k points, so every size starts with buffers sized for a smaller cloud
+    const int cloud_sizes[][2] = {{128, 80}, {400, 250}, {640, 480}};
+    const size_t num_cloud_sizes = sizeof(cloud_sizes) / sizeof(cloud_sizes[0]);
+    bool is_allocation_free = true;
+    for (size_t i = 0; i < pipeline_files.size(); i++)
+    {
+        DrawerHandleDetector detector;
+        try
+        {
+            detector.configureFromFile(pipeline_files[i]);
+        }
+        catch (std::exception &ex)
+        {
+            fprintf(stderr, "Invalid pipeline %s: %s\n", pipeline_files[i].c_str(), ex.what());
+            return 1;
+        }
+
+        printf("%s\n", pipeline_files[i].c_str());
+        std::vector<double> allocations(num_cloud_sizes);
+        std::vector<double> kbytes(num_cloud_sizes);
+        for (size_t j = 0; j < num_cloud_sizes; j++)
+        {
+            benchmarkCloudSize(detector, cloud_sizes[j][0], cloud_sizes[j][1], num_iterations, allocations[j],
+                               kbytes[j]);
+        }
+
+        const size_t last = num_cloud_sizes - 1;
+        if (allocations[last] > (1.0 + ALLOCATION_TOLERANCE) * allocations[0] ||
+            kbytes[last] > (1.0 + ALLOCATION_TOLERANCE) * kbytes[0])
+        {
+            printf("FAILED: steady state allocations grow with the cloud size, %.1f allocs %.1f KB per frame "
+                   "at %dx%d, %.1f allocs %.1f KB at %dx%d\n\n", allocations[0], kbytes[0], cloud_sizes[0][0],
+                   cloud_sizes[0][1], allocations[last], kbytes[last], cloud_sizes[last][0], cloud_sizes[last][1]);
+            is_allocation_free = false;
+        }
+        else
+        {
+            printf("steady state allocations do not grow with the cloud size\n\n");
+        }
+    }
+    return is_allocation_free ? 0 : 2;
+}
@@ -0,0 +1,184 @@
+/*
+ * Replays recorded point clouds from PCD files through the drawer handle detection
+ * as fast as possible, without ROS, and reports the detection rate, the throughput,
+ * the latency percentiles of every pipeline stage and the deviation of the detected
+ * handle from its labelled pose. Used to tune the pipeline offline.
+ *
+ * All clouds are loaded before the replay, so only the detection is timed. The clouds
+ * are moved into the output frame by the viewpoint stored in the PCD file (see
+ * pcl_ros/pointcloud_to_pcd), unless the labels give their transform. The labels file
+ * is a YAML file of the form
+ *
+ *   # label and transform of every cloud, both optional
+ *   handle: {position: [0.575, 0.0, 0.03], axis: [0.0, 1.0, 0.0]}
+ *   transform: {translation: [0.1, 0.0, 0.3], rotation: [0.0, 0.0, 0.0, 1.0]}  # x, y, z, w
+ *   # overrides for single clouds, by file name
+ *   clouds:
+ *     drawer_001.pcd:
+ *       handle: {position: [0.58, 0.02, 0.03]}
+ *
+ * Usage: drawer_handle_replay [--pipeline FILE] [--labels FILE] [--repeat N] CLOUD.pcd...
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <pcl/io/pcd_io.h>
+
+#include <mir_handle_detection/drawer_handle_detector.h>
+#include <mir_handle_detection/replay_statistics.h>
+
+namespace
+{
+struct Frame
+{
+    std::string filename;
+    PCloudT::Ptr cloud;
+    Eigen::Affine3f transform;
+    bool has_label;
+    HandleLabel label;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+Eigen::Affine3f parseTransform(const YAML::Node &node)
+{
+    std::vector<float> translation = node["translation"].as<std::vector<float> >();
+    std::vector<float> rotation = node["rotation"].as<std::vector<float> >();
+    if (translation.size() != 3 || rotation.size() != 4)
+    {
+        throw YAML::RepresentationException(node.Mark(), "a transform needs a translation and a quaternion");
+    }
+    return Eigen::Translation3f(translation[0], translation[1], translation[2]) *
+           Eigen::Quaternionf(rotation[3], rotation[0], rotation[1], rotation[2]).normalized();
+}
+
+/**
+ * Apply the label and transform of node to frame, if node has them
+ */
+void applyLabels(const YAML::Node &node, Frame &frame)
+{
+    if (node["handle"])
+    {
+        frame.label = parseHandleLabel(node["handle"]);
+        frame.has_label = true;
+    }
+    if (node["transform"])
+    {
+        frame.transform = parseTransform(node["transform"]);
+    }
+}
+
+std::string getFileName(const std::string &path)
+{
+    size_t separator = path.find_last_of('/');
+    return separator == std::string::npos ? path : path.substr(separator + 1);
+}
+}
+
+int main(int argc, char **argv)
+{
+    std::string pipeline_file = PIPELINE_CONFIG_DIR "/drawer_handle_pipeline.yaml";
+    std::string labels_file;
+    int num_repeats = 1;
+    std::vector<std::string> cloud_files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            pipeline_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc)
+        {
+            labels_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            num_repeats = std::max(1, atoi(argv[++i]));
+        }
+        else if (argv[i][0] != '-')
+        {
+            cloud_files.push_back(argv[i]);
+        }
+        else
+        {
+            cloud_files.clear();
+            break;
+        }
+    }
+    if (cloud_files.empty())
+    {
+        fprintf(stderr, "Usage: %s [--pipeline FILE] [--labels FILE] [--repeat N] CLOUD.pcd...\n", argv[0]);
+        return 1;
+    }
+
+    DrawerHandleDetector detector;
+    YAML::Node labels;
+    try
+    {
+        detector.configureFromFile(pipeline_file);
+        if (!labels_file.empty())
+        {
+            labels = YAML::LoadFile(labels_file);
+        }
+    }
+    catch (std::exception &ex)
+    {
+        fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+
+    std::vector<Frame, Eigen::aligned_allocator<Frame> > frames(cloud_files.size());
+    for (size_t i = 0; i < cloud_files.size(); i++)
+    {
+        Frame &frame = frames[i];
+        frame.filename = cloud_files[i];
+        frame.cloud.reset(new PCloudT);
+        if (pcl::io::loadPCDFile(frame.filename, *frame.cloud) < 0)
+        {
+            fprintf(stderr, "Could not read %s\n", frame.filename.c_str());
+            return 1;
+        }
+        frame.transform = Eigen::Translation3f(frame.cloud->sensor_origin_.head<3>()) *
+                          frame.cloud->sensor_orientation_;
+        frame.has_label = false;
+        try
+        {
+            applyLabels(labels, frame);
+            if (labels["clouds"] && labels["clouds"][getFileName(frame.filename)])
+            {
+                applyLabels(labels["clouds"][getFileName(frame.filename)], frame);
+            }
+        }
+        catch (std::exception &ex)
+        {
+            fprintf(stderr, "Invalid labels of %s: %s\n", frame.filename.c_str(), ex.what());
+            return 1;
+        }
+    }
+
+    ReplayStatistics statistics;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int repeat = 0; repeat < num_repeats; repeat++)
+    {
+        // every pass starts without the drawer plane of the previous one
+        detector.reset();
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            Eigen::Affine3f handle_pose = Eigen::Affine3f::Identity();
+            bool is_found = detector.detect(*frames[i].cloud, frames[i].transform, handle_pose);
+            statistics.addFrame(detector, is_found, handle_pose, frames[i].has_label ? &frames[i].label : NULL);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s, %zu clouds replayed %d times in %.3f s\n\n", pipeline_file.c_str(), frames.size(), num_repeats,
+           seconds);
+    statistics.print(stdout);
+    return 0;
+}
@@ -5,27 +5,28 @@
 
 #include <sensor_msgs/PointCloud2.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
 #include <std_msgs/String.h>
+#include <std_msgs/Float64.h>
 
-#include <pcl_conversions/pcl_conversions.h>
+#include <message_filters/subscriber.h>
+#include <tf2_ros/buffer.h>
+#include <tf2_ros/message_filter.h>
+#include <tf2_ros/transform_listener.h>
 
-#include <pcl_ros/transforms.h>
+#include <pcl_conversions/pcl_conversions.h>
 
 #include <pcl/point_types.h>
-#include <pcl/filters/passthrough.h>
-#include <pcl/filters/voxel_grid.h>
-#include <pcl/filters/extract_indices.h>
-#include <pcl/filters/project_inliers.h>
-#include <pcl/segmentation/sac_segmentation.h>
-#include <pcl/segmentation/extract_polygonal_prism_data.h>
-#include <pcl/segmentation/extract_clusters.h>
-#include <pcl/surface/convex_hull.h>
-#include <pcl/common/centroid.h>
-#include <pcl/common/norms.h>
 
 #include <Eigen/Eigenvalues>
 
-typedef pcl::PointCloud<pcl::PointXYZ> PCloudT;
+#include <boost/shared_ptr.hpp>
+#include <map>
+
+#include <mir_handle_detection/drawer_handle_detector.h>
+#include <mir_handle_detection/handle_position_estimator.h>
+#include <mir_handle_detection/point_cloud2_xyz.h>
+
 class DrawerHandlePerceiver
 {
     public:
@@ -34,35 +35,49 @@ class DrawerHandlePerceiver
 
     private:
         ros::NodeHandle nh;
-        ros::Subscriber pc_sub;
         ros::Subscriber event_in_sub;
         ros::Publisher pc_pub;
         ros::Publisher pose_pub;
+        ros::Publisher pose_with_covariance_pub;
         ros::Publisher event_out_pub;
+        ros::Publisher tf_wait_time_pub;
 
         std::string output_frame;
         bool enable_debug_pc_pub;
         bool is_running;
-        int retry_attempts_;
-        int num_of_retries_;
-        tf::TransformListener tf_listener;
+        /**
+         * Clouds are only passed to pcCallback by the message filter once the transform
+         * to output_frame at their stamp is available, so the callback never waits for TF
+         */
+        tf2_ros::Buffer tf_buffer;
+        tf2_ros::TransformListener tf_listener;
+        message_filters::Subscriber<sensor_msgs::PointCloud2> pc_sub;
+        boost::shared_ptr<tf2_ros::MessageFilter<sensor_msgs::PointCloud2> > pc_tf_filter;
+        /**
+         * Time at which the clouds waiting in the message filter were received, by stamp
+         */
+        std::map<ros::Time, ros::Time> pc_receive_times;
+        std_msgs::Float64 tf_wait_time_msg;
+
+        DrawerHandleDetector detector;
+        sensor_msgs::PointCloud2 debug_pc_msg;
 
-        pcl::PassThrough<pcl::PointXYZ> passthrough_filter_y;
-        pcl::PassThrough<pcl::PointXYZ> passthrough_filter_z;
-        pcl::VoxelGrid<pcl::PointXYZ> voxel_grid_filter;
-        pcl::SACSegmentation<pcl::PointXYZ> seg;
-        pcl::ProjectInliers<pcl::PointXYZ> project_inliers;
-        pcl::ConvexHull<pcl::PointXYZ> convex_hull;
-        pcl::ExtractPolygonalPrismData<pcl::PointXYZ> extract_polygonal_prism;
-        pcl::ExtractIndices<pcl::PointXYZ> extract_indices;
-        pcl::EuclideanClusterExtraction<pcl::PointXYZ> euclidean_cluster_extraction;
+        /**
+         * Detections of consecutive frames are fused until they converge, e_failure is
+         * sent if that does not happen within estimation_timeout seconds of e_start
+         */
+        HandlePositionEstimator estimator;
+        double estimation_timeout;
+        ros::Timer timeout_timer;
 
-        void checkFailure();
         void pcCallback(const sensor_msgs::PointCloud2::ConstPtr &msg);
+        void pcReceivedCallback(const sensor_msgs::PointCloud2::ConstPtr &msg);
+        void pcDroppedCallback(const sensor_msgs::PointCloud2::ConstPtr &msg,
+                               tf2_ros::filter_failure_reasons::FilterFailureReason reason);
         void eventInCallback(const std_msgs::String::ConstPtr &msg);
-        bool transformPC(const sensor_msgs::PointCloud2::ConstPtr &msg, sensor_msgs::PointCloud2 &msg_transformed);
-        void passthroughFilterPC(const PCloudT::Ptr &input, PCloudT::Ptr output);
-        void extractPlaneOutlier(const PCloudT::Ptr &input, PCloudT::Ptr dense_input, PCloudT::Ptr output);
-        bool getClosestCluster(const PCloudT::Ptr &input, Eigen::Vector4f &closest_centroid);
+        void timeoutCallback(const ros::TimerEvent &event);
+        void publishEstimate(const PCloudT::ConstPtr &debug_pc);
+        void stop(const std::string &event_out);
+        bool getTransform(const sensor_msgs::PointCloud2::ConstPtr &msg, Eigen::Affine3f &transform);
 };
 #endif
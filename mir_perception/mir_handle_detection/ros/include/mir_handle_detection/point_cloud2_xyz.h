@@ -0,0 +1,59 @@
+#ifndef POINT_CLOUD2_XYZ_H
+#define POINT_CLOUD2_XYZ_H
+
+#include <string>
+
+#include <geometry_msgs/Transform.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <Eigen/Geometry>
+
+/**
+ * Byte offset of x in every point of the cloud, or -1 if x, y and z are not
+ * consecutive float fields which can be read from the message buffer directly
+ */
+inline int getXYZOffset(const sensor_msgs::PointCloud2 &msg)
+{
+    int x_index = -1;
+    for (size_t i = 0; i < msg.fields.size(); i++)
+    {
+        if (msg.fields[i].name == "x")
+        {
+            x_index = i;
+        }
+    }
+    // depth cameras publish x, y and z as consecutive float fields
+    if (x_index < 0 || x_index + 2 >= static_cast<int>(msg.fields.size()) || msg.is_bigendian ||
+        msg.row_step != msg.width * msg.point_step || msg.data.size() < msg.row_step * msg.height)
+    {
+        return -1;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        const sensor_msgs::PointField &field = msg.fields[x_index + i];
+        if (field.name != std::string(1, 'x' + i) || field.datatype != sensor_msgs::PointField::FLOAT32 ||
+            field.offset != msg.fields[x_index].offset + i * sizeof(float))
+        {
+            return -1;
+        }
+    }
+    return msg.fields[x_index].offset;
+}
+
+/**
+ * frame_id without a leading slash: tf2_ros::MessageFilter strips it, but tf2::BufferCore
+ * rejects it in lookups, while tf1 accepted it
+ */
+inline std::string stripLeadingSlash(const std::string &frame_id)
+{
+    return !frame_id.empty() && frame_id[0] == '/' ? frame_id.substr(1) : frame_id;
+}
+
+inline Eigen::Affine3f toAffine3f(const geometry_msgs::Transform &transform)
+{
+    const geometry_msgs::Vector3 &translation = transform.translation;
+    const geometry_msgs::Quaternion &rotation = transform.rotation;
+    return Eigen::Translation3f(translation.x, translation.y, translation.z) *
+           Eigen::Quaternionf(rotation.w, rotation.x, rotation.y, rotation.z);
+}
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Replays the point clouds of a rosbag through the drawer handle detection as fast as
+ * possible, without a running ROS master, and reports the same statistics as
+ * drawer_handle_replay. The clouds are transformed into the output frame with the
+ * /tf and /tf_static messages recorded in the bag, clouds without a transform are
+ * counted as skipped. The labels file holds the pose of the handle in the output frame,
+ * {handle: {position: [x, y, z], axis: [x, y, z]}}, which is the same for every cloud.
+ *
+ * Usage: drawer_handle_bag_replay [--pipeline FILE] [--labels FILE] [--topic TOPIC]
+ *                                 [--output-frame FRAME] BAG
+ */
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <vector>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf2/buffer_core.h>
+#include <tf2/exceptions.h>
+#include <tf2_msgs/TFMessage.h>
+
+#include <mir_handle_detection/drawer_handle_detector.h>
+#include <mir_handle_detection/point_cloud2_xyz.h>
+#include <mir_handle_detection/replay_statistics.h>
+
+int main(int argc, char **argv)
+{
+    std::string pipeline_file = PIPELINE_CONFIG_DIR "/drawer_handle_pipeline.yaml";
+    std::string labels_file;
+    std::string topic = "/arm_cam3d/depth_registered/points";
+    std::string output_frame = "base_link_static";
+    std::string bag_file;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            pipeline_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--labels") == 0 && i + 1 < argc)
+        {
+            labels_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--topic") == 0 && i + 1 < argc)
+        {
+            topic = argv[++i];
+        }
+        else if (strcmp(argv[i], "--output-frame") == 0 && i + 1 < argc)
+        {
+            output_frame = stripLeadingSlash(argv[++i]);
+        }
+        else if (argv[i][0] != '-' && bag_file.empty())
+        {
+            bag_file = argv[i];
+        }
+        else
+        {
+            bag_file.clear();
+            break;
+        }
+    }
+    if (bag_file.empty())
+    {
+        fprintf(stderr, "Usage: %s [--pipeline FILE] [--labels FILE] [--topic TOPIC] [--output-frame FRAME] BAG\n",
+                argv[0]);
+        return 1;
+    }
+
+    // rosbag and tf2 use ros::Time, which works without ros::init once initialized
+    ros::Time::init();
+
+    DrawerHandleDetector detector;
+    bool has_label = false;
+    HandleLabel label;
+    rosbag::Bag bag;
+    try
+    {
+        detector.configureFromFile(pipeline_file);
+        if (!labels_file.empty())
+        {
+            YAML::Node labels = YAML::LoadFile(labels_file);
+            if (labels["handle"])
+            {
+                label = parseHandleLabel(labels["handle"]);
+                has_label = true;
+            }
+        }
+        bag.open(bag_file, rosbag::bagmode::Read);
+    }
+    catch (std::exception &ex)
+    {
+        fprintf(stderr, "%s\n", ex.what());
+        return 1;
+    }
+
+    // all transforms are read first, so a cloud can be transformed with the ones recorded after it
+    rosbag::View tf_view(bag, rosbag::TopicQuery(std::vector<std::string>{"/tf", "/tf_static"}));
+    ros::Duration bag_duration = tf_view.getEndTime() - tf_view.getBeginTime();
+    tf2::BufferCore tf_buffer(bag_duration + ros::Duration(tf2::BufferCore::DEFAULT_CACHE_TIME));
+    for (rosbag::View::iterator it = tf_view.begin(); it != tf_view.end(); ++it)
+    {
+        tf2_msgs::TFMessage::ConstPtr tf_msg = it->instantiate<tf2_msgs::TFMessage>();
+        if (!tf_msg)
+        {
+            continue;
+        }
+        bool is_static = it->getTopic() == "/tf_static";
+        for (size_t i = 0; i < tf_msg->transforms.size(); i++)
+        {
+            tf_buffer.setTransform(tf_msg->transforms[i], "bag", is_static);
+        }
+    }
+
+    ReplayStatistics statistics;
+    rosbag::View pc_view(bag, rosbag::TopicQuery(topic));
+    ros::WallTime start = ros::WallTime::now();
+    for (rosbag::View::iterator it = pc_view.begin(); it != pc_view.end(); ++it)
+    {
+        sensor_msgs::PointCloud2::ConstPtr msg = it->instantiate<sensor_msgs::PointCloud2>();
+        if (!msg)
+        {
+            continue;
+        }
+        int xyz_offset = getXYZOffset(*msg);
+        if (xyz_offset < 0)
+        {
+            statistics.addSkippedFrame();
+            continue;
+        }
+        Eigen::Affine3f transform;
+        try
+        {
+            geometry_msgs::TransformStamped transform_stamped = tf_buffer.lookupTransform(
+                output_frame, stripLeadingSlash(msg->header.frame_id), msg->header.stamp);
+            transform = toAffine3f(transform_stamped.transform);
+        }
+        catch (tf2::TransformException &ex)
+        {
+            statistics.addSkippedFrame();
+            continue;
+        }
+
+        Eigen::Affine3f handle_pose = Eigen::Affine3f::Identity();
+        bool is_found = detector.detect(msg->data.data(), msg->width, msg->height, msg->point_step, xyz_offset,
+                                        transform, handle_pose);
+        statistics.addFrame(detector, is_found, handle_pose, has_label ? &label : NULL);
+    }
+    double seconds = (ros::WallTime::now() - start).toSec();
+    bag.close();
+
+    printf("%s, %s of %s replayed in %.3f s\n\n", pipeline_file.c_str(), topic.c_str(), bag_file.c_str(), seconds);
+    statistics.print(stdout);
+    return 0;
+}
@@ -1,14 +1,32 @@
 #include <mir_handle_detection/drawer_handle_perceiver.h>
 
-DrawerHandlePerceiver::DrawerHandlePerceiver() : nh("~")
+DrawerHandlePerceiver::DrawerHandlePerceiver() : nh("~"), tf_listener(tf_buffer)
 {
     nh.param<std::string>("output_frame", this->output_frame, "base_link_static");
+    this->output_frame = stripLeadingSlash(this->output_frame);
     nh.param<bool>("enable_debug_pc_pub", this->enable_debug_pc_pub, true);
-    nh.param<int>("num_of_retries", this->num_of_retries_, 3);
-    this->retry_attempts_ = 0;
 
-    this->pc_sub = nh.subscribe("input_point_cloud", 1, &DrawerHandlePerceiver::pcCallback, this);
+    int estimation_window_size, estimation_min_inliers;
+    float estimation_outlier_distance, estimation_convergence_stddev;
+    nh.param<int>("estimation_window_size", estimation_window_size, 10);
+    nh.param<int>("estimation_min_inliers", estimation_min_inliers, 3);
+    nh.param<float>("estimation_outlier_distance", estimation_outlier_distance, 0.02);
+    nh.param<float>("estimation_convergence_stddev", estimation_convergence_stddev, 0.005);
+    nh.param<double>("estimation_timeout", this->estimation_timeout, 5.0);
+    this->estimator.setParameters(estimation_window_size, estimation_min_inliers, estimation_outlier_distance,
+                                  estimation_convergence_stddev);
+
+    this->pc_sub.subscribe(nh, "input_point_cloud", 1);
+    this->pc_sub.registerCallback(&DrawerHandlePerceiver::pcReceivedCallback, this);
+    this->pc_tf_filter.reset(new tf2_ros::MessageFilter<sensor_msgs::PointCloud2>(this->pc_sub, this->tf_buffer,
+                                                                                  this->output_frame, 5, nh));
+    this->pc_tf_filter->registerCallback(&DrawerHandlePerceiver::pcCallback, this);
+    this->pc_tf_filter->registerFailureCallback(boost::bind(&DrawerHandlePerceiver::pcDroppedCallback,
+                                                            this, _1, _2));
+    this->tf_wait_time_pub = nh.advertise<std_msgs::Float64>("tf_wait_time", 1);
     this->pose_pub = nh.advertise<geometry_msgs::PoseStamped>("output_pose", 1);
+    this->pose_with_covariance_pub = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>(
+                                         "output_pose_with_covariance", 1);
     this->event_in_sub = nh.subscribe("event_in", 1, &DrawerHandlePerceiver::eventInCallback, this);
     this->event_out_pub = nh.advertise<std_msgs::String>("event_out", 1);
 
@@ -17,54 +35,17 @@ DrawerHandlePerceiver::DrawerHandlePerceiver() : nh("~")
         this->pc_pub = nh.advertise<sensor_msgs::PointCloud2>("output_point_cloud", 1);
     }
 
-    float z_threshold_max, z_threshold_min;
-    nh.param<float>("z_threshold_min", z_threshold_min, -0.1);
-    nh.param<float>("z_threshold_max", z_threshold_max, 0.3);
-    this->passthrough_filter_z.setFilterFieldName ("z");
-    this->passthrough_filter_z.setFilterLimits (z_threshold_min, z_threshold_max);
-
-    float y_threshold_max, y_threshold_min;
-    nh.param<float>("y_threshold_min", y_threshold_min, -0.1);
-    nh.param<float>("y_threshold_max", y_threshold_max, 0.1);
-    this->passthrough_filter_y.setFilterFieldName ("y");
-    this->passthrough_filter_y.setFilterLimits (y_threshold_min, y_threshold_max);
-
-    float leaf_size_x, leaf_size_y, leaf_size_z;
-    nh.param<float>("leaf_size_x", leaf_size_x, 0.01);
-    nh.param<float>("leaf_size_y", leaf_size_y, 0.01);
-    nh.param<float>("leaf_size_z", leaf_size_z, 0.01);
-    this->voxel_grid_filter.setLeafSize (leaf_size_x, leaf_size_y, leaf_size_z);
-
-    float seg_dist_threshold, seg_axis_x, seg_axis_y, seg_axis_z;
-    nh.param<float>("seg_dist_threshold", seg_dist_threshold, 0.01);
-    nh.param<float>("seg_axis_x", seg_axis_x, 1.0);
-    nh.param<float>("seg_axis_y", seg_axis_y, 0.0);
-    nh.param<float>("seg_axis_z", seg_axis_z, 0.0);
-    this->seg.setOptimizeCoefficients(true);
-    this->seg.setModelType(pcl::SACMODEL_PERPENDICULAR_PLANE);
-    Eigen::Vector3f axis(seg_axis_x, seg_axis_y, seg_axis_z);
-    this->seg.setAxis(axis);
-    this->seg.setMethodType(pcl::SAC_RANSAC);
-    this->seg.setDistanceThreshold(seg_dist_threshold);
-
-    this->project_inliers.setModelType(pcl::SACMODEL_NORMAL_PARALLEL_PLANE);
-    this->project_inliers.setCopyAllData(false);
-
-    float polygon_prism_height_min, polygon_prism_height_max;
-    nh.param<float>("polygon_prism_height_min", polygon_prism_height_min, 0.01);
-    nh.param<float>("polygon_prism_height_max", polygon_prism_height_max, 0.1);
-    this->extract_polygonal_prism.setHeightLimits(polygon_prism_height_min, polygon_prism_height_max);
-
-    this->extract_indices.setNegative(false);
-
-    float cluster_tolerance;
-    int min_cluster_size, max_cluster_size;
-    nh.param<float>("cluster_tolerance", cluster_tolerance, 0.02);
-    nh.param<int>("min_cluster_size", min_cluster_size, 50);
-    nh.param<int>("max_cluster_size", max_cluster_size, 10000);
-    this->euclidean_cluster_extraction.setClusterTolerance(cluster_tolerance);
-    this->euclidean_cluster_extraction.setMinClusterSize(min_cluster_size);
-    this->euclidean_cluster_extraction.setMaxClusterSize(max_cluster_size);
+    std::string pipeline_file;
+    nh.param<std::string>("pipeline_file", pipeline_file, "");
+    try
+    {
+        this->detector.configureFromFile(pipeline_file);
+    }
+    catch (std::exception &ex)
+    {
+        ROS_FATAL("[drawer_handle_perceiver] Invalid pipeline %s: %s", pipeline_file.c_str(), ex.what());
+        ros::shutdown();
+    }
 
     this->is_running = false;
 }
@@ -78,198 +59,180 @@ void DrawerHandlePerceiver::eventInCallback(const std_msgs::String::ConstPtr &ms
     if (msg->data == "e_start")
     {
         ROS_INFO_STREAM("starting listening");
+        this->detector.reset();
+        this->estimator.reset();
+        this->timeout_timer = nh.createTimer(ros::Duration(this->estimation_timeout),
+                                             &DrawerHandlePerceiver::timeoutCallback, this, true);
         this->is_running = true;
     }
     else if (msg->data == "e_stop")
     {
         ROS_INFO_STREAM("stopping listening");
+        this->timeout_timer.stop();
         this->is_running = false;
     }
 }
 
-void DrawerHandlePerceiver::checkFailure()
+void DrawerHandlePerceiver::timeoutCallback(const ros::TimerEvent &event)
 {
-    if (this->retry_attempts_ > this->num_of_retries_)
+    if (!this->is_running)
     {
-        std_msgs::String event_out_msg;
-        event_out_msg.data = "e_failure";
-        this->event_out_pub.publish(event_out_msg);
-        this->is_running = false;
-        this->retry_attempts_ = 0;
+        return;
+    }
+
+    ROS_ERROR("[drawer_handle_perceiver] Handle position did not converge within %.1f s (%d detections).",
+              this->estimation_timeout, this->estimator.getNumDetections());
+    this->stop("e_failure");
+}
+
+void DrawerHandlePerceiver::stop(const std::string &event_out)
+{
+    std_msgs::String event_out_msg;
+    event_out_msg.data = event_out;
+    this->event_out_pub.publish(event_out_msg);
+    this->timeout_timer.stop();
+    this->is_running = false;
+}
+
+void DrawerHandlePerceiver::pcReceivedCallback(const sensor_msgs::PointCloud2::ConstPtr &msg)
+{
+    this->pc_receive_times[msg->header.stamp] = ros::Time::now();
+}
+
+void DrawerHandlePerceiver::pcDroppedCallback(const sensor_msgs::PointCloud2::ConstPtr &msg,
+                                              tf2_ros::filter_failure_reasons::FilterFailureReason reason)
+{
+    this->pc_receive_times.erase(msg->header.stamp);
+    if (this->is_running)
+    {
+        ROS_WARN_THROTTLE(1.0, "[drawer_handle_perceiver] Dropped pointcloud, no transform from %s to %s.",
+                          msg->header.frame_id.c_str(), this->output_frame.c_str());
     }
-    else
-        this->retry_attempts_ += 1;
 }
 
 void DrawerHandlePerceiver::pcCallback(const sensor_msgs::PointCloud2::ConstPtr &msg)
 {
+    // time the cloud spent in the message filter waiting for its transform
+    std::map<ros::Time, ros::Time>::iterator receive_time = this->pc_receive_times.find(msg->header.stamp);
+    if (receive_time != this->pc_receive_times.end())
+    {
+        this->tf_wait_time_msg.data = (ros::Time::now() - receive_time->second).toSec() * 1000.0;
+        this->tf_wait_time_pub.publish(this->tf_wait_time_msg);
+        // clouds received earlier have been passed on or dropped by now
+        this->pc_receive_times.erase(this->pc_receive_times.begin(), ++receive_time);
+    }
+
     if (!this->is_running)
     {
         return;
     }
 
-    sensor_msgs::PointCloud2 msg_transformed;
-    bool success = this->transformPC(msg, msg_transformed);
+    // failures only delay the estimate, the timeout decides when to give up
+    Eigen::Affine3f transform;
+    bool success = this->getTransform(msg, transform);
     if (!success)
     {
-        ROS_ERROR("[drawer_handle_perceiver] Could not transform pointcloud.");
-        this->checkFailure();
+        ROS_WARN_THROTTLE(1.0, "[drawer_handle_perceiver] Could not transform pointcloud.");
         return;
     }
 
-    PCloudT::Ptr pc_input(new PCloudT);
-    pcl::fromROSMsg(msg_transformed, *pc_input);
-
-    PCloudT::Ptr pc_passthrough_filtered(new PCloudT);
-    this->passthroughFilterPC(pc_input, pc_passthrough_filtered);
+    int xyz_offset = getXYZOffset(*msg);
+    if (xyz_offset < 0)
+    {
+        ROS_ERROR_THROTTLE(1.0, "[drawer_handle_perceiver] Pointcloud has no consecutive float x, y and z fields.");
+        return;
+    }
 
-    PCloudT::Ptr pc_filtered(new PCloudT);
-    this->voxel_grid_filter.setInputCloud(pc_passthrough_filtered);
-    this->voxel_grid_filter.filter(*pc_filtered);
+    Eigen::Affine3f handle_pose;
+    bool detect_success = this->detector.detect(msg->data.data(), msg->width, msg->height, msg->point_step,
+                                                xyz_offset, transform, handle_pose);
+    if (!detect_success)
+    {
+        ROS_WARN_THROTTLE(1.0, "[drawer_handle_perceiver] Could not find the handle.");
+        return;
+    }
 
-    PCloudT::Ptr pc_segmented(new PCloudT);
-    this->extractPlaneOutlier(pc_filtered, pc_passthrough_filtered, pc_segmented);
+    this->estimator.addDetection(handle_pose.translation(), Eigen::Quaternionf(handle_pose.linear()));
+    if (this->estimator.isConverged())
+    {
+        this->publishEstimate(this->detector.getSegmentedCloud());
+    }
+}
 
-    Eigen::Vector4f closest_centroid(0.0, 0.0, 0.0, 0.0);
-    bool cluster_success = this->getClosestCluster(pc_segmented, closest_centroid);
-    if (!cluster_success)
+void DrawerHandlePerceiver::publishEstimate(const PCloudT::ConstPtr &debug_pc)
+{
+    Eigen::Vector3f position;
+    Eigen::Matrix3f covariance;
+    this->estimator.getEstimate(position, covariance);
+
+    geometry_msgs::PoseWithCovarianceStamped pose_with_covariance;
+    pose_with_covariance.header.frame_id = this->output_frame;
+    pose_with_covariance.header.stamp = ros::Time::now();
+    pose_with_covariance.pose.pose.position.x = position[0];
+    pose_with_covariance.pose.pose.position.y = position[1];
+    pose_with_covariance.pose.pose.position.z = position[2];
+
+    // without an orientation, e.g. from the closest cluster, it is unknown
+    Eigen::Quaternionf orientation = Eigen::Quaternionf::Identity();
+    float orientation_variance = 1e6;
+    if (this->detector.hasOrientation())
     {
-        ROS_ERROR("[drawer_handle_perceiver] Could not find any cluster.");
-        this->checkFailure();
-        return;
+        this->estimator.getOrientation(orientation, orientation_variance);
+    }
+    pose_with_covariance.pose.pose.orientation.x = orientation.x();
+    pose_with_covariance.pose.pose.orientation.y = orientation.y();
+    pose_with_covariance.pose.pose.orientation.z = orientation.z();
+    pose_with_covariance.pose.pose.orientation.w = orientation.w();
+    for (int row = 0; row < 3; row++)
+    {
+        for (int column = 0; column < 3; column++)
+        {
+            pose_with_covariance.pose.covariance[row * 6 + column] = covariance(row, column);
+        }
+        pose_with_covariance.pose.covariance[(row + 3) * 6 + row + 3] = orientation_variance;
     }
+    this->pose_with_covariance_pub.publish(pose_with_covariance);
 
     geometry_msgs::PoseStamped pose_stamped;
-    pose_stamped.pose.position.x = closest_centroid[0];
-    pose_stamped.pose.position.y = closest_centroid[1];
-    pose_stamped.pose.position.z = closest_centroid[2];
-    pose_stamped.pose.orientation.w = 1.0;
-    pose_stamped.header.frame_id = this->output_frame;
-    pose_stamped.header.stamp = ros::Time::now();
+    pose_stamped.header = pose_with_covariance.header;
+    pose_stamped.pose = pose_with_covariance.pose.pose;
     this->pose_pub.publish(pose_stamped);
 
-    std_msgs::String event_out_msg;
-    event_out_msg.data = "e_done";
-    this->event_out_pub.publish (event_out_msg);
-    ROS_INFO("[drawer_handle_perceiver] SUCCESSFUL");
-
-    this->is_running = false;
-    this->retry_attempts_ = 0;
+    ROS_INFO("[drawer_handle_perceiver] SUCCESSFUL after %d detections", this->estimator.getNumDetections());
+    this->stop("e_done");
 
     if (this->enable_debug_pc_pub)
     {
         /* publish debug pointcloud */
-        sensor_msgs::PointCloud2 output;
-        pcl::toROSMsg(*pc_segmented, output);
-        output.header.frame_id = this->output_frame;
-        output.header.stamp = ros::Time::now();
-        this->pc_pub.publish(output);
+        pcl::toROSMsg(*debug_pc, this->debug_pc_msg);
+        this->debug_pc_msg.header.frame_id = this->output_frame;
+        this->debug_pc_msg.header.stamp = ros::Time::now();
+        this->pc_pub.publish(this->debug_pc_msg);
         ROS_INFO("Publishing debug pointcloud");
     }
 }
 
-bool DrawerHandlePerceiver::transformPC(const sensor_msgs::PointCloud2::ConstPtr &msg, sensor_msgs::PointCloud2 &msg_transformed)
+bool DrawerHandlePerceiver::getTransform(const sensor_msgs::PointCloud2::ConstPtr &msg, Eigen::Affine3f &transform)
 {
-    msg_transformed.header.frame_id = this->output_frame;
     try
     {
-        ros::Time common_time;
-        this->tf_listener.getLatestCommonTime(this->output_frame, msg->header.frame_id, common_time, NULL);
-        tf::StampedTransform transform;
-        this->tf_listener.waitForTransform(this->output_frame, msg->header.frame_id,
-                                           common_time, ros::Duration(1.0));
-        this->tf_listener.lookupTransform(this->output_frame, msg->header.frame_id,
-                                          common_time, transform);
-        pcl_ros::transformPointCloud(this->output_frame, transform, *msg, msg_transformed);
+        // available, since the message filter checked it
+        geometry_msgs::TransformStamped transform_stamped = this->tf_buffer.lookupTransform(
+            this->output_frame, stripLeadingSlash(msg->header.frame_id), msg->header.stamp);
+        transform = toAffine3f(transform_stamped.transform);
         return true;
     }
-    catch (tf::TransformException &ex)
+    catch (tf2::TransformException &ex)
     {
-        ROS_WARN("PCL transform error: %s", ex.what());
-        ros::Duration(1.0).sleep();
+        ROS_WARN_THROTTLE(1.0, "PCL transform error: %s", ex.what());
         return false;
     }
 }
 
-void DrawerHandlePerceiver::passthroughFilterPC(const PCloudT::Ptr &input, PCloudT::Ptr output)
-{
-    PCloudT::Ptr pc_intermediate(new PCloudT);
-    this->passthrough_filter_z.setInputCloud(input);
-    this->passthrough_filter_z.filter(*pc_intermediate);
-    this->passthrough_filter_y.setInputCloud(pc_intermediate);
-    this->passthrough_filter_y.filter(*output);
-}
-
-void DrawerHandlePerceiver::extractPlaneOutlier(const PCloudT::Ptr &input, PCloudT::Ptr dense_input, PCloudT::Ptr output)
-{
-    pcl::ModelCoefficients::Ptr coefficients(new pcl::ModelCoefficients);
-    pcl::PointIndices::Ptr inliers(new pcl::PointIndices);
-    this->seg.setInputCloud(input);
-    this->seg.segment(*inliers, *coefficients);
-
-    //Project plane model inliers to plane
-    PCloudT::Ptr pc_plane(new PCloudT);
-    this->project_inliers.setInputCloud(input);
-    this->project_inliers.setModelCoefficients(coefficients);
-    this->project_inliers.setIndices(inliers);
-    this->project_inliers.filter(*pc_plane);
-
-    //Compute plane convex hull
-    PCloudT::Ptr pc_hull(new PCloudT);
-    this->convex_hull.setInputCloud(pc_plane);
-    this->convex_hull.reconstruct(*pc_hull);
-
-    //Extract points inside polygonal prism of plane convex hull
-    pcl::PointIndices::Ptr segmented_cloud_inliers(new pcl::PointIndices);
-    this->extract_polygonal_prism.setInputPlanarHull(pc_hull);
-    this->extract_polygonal_prism.setInputCloud(dense_input);
-    this->extract_polygonal_prism.segment(*segmented_cloud_inliers);
-
-    // Extract the outliers
-    this->extract_indices.setInputCloud(dense_input);
-    this->extract_indices.setIndices(segmented_cloud_inliers);
-    this->extract_indices.filter(*output);
-}
-
-bool DrawerHandlePerceiver::getClosestCluster(const PCloudT::Ptr &input, Eigen::Vector4f &closest_centroid)
-{
-    pcl::search::KdTree<pcl::PointXYZ>::Ptr tree (new pcl::search::KdTree<pcl::PointXYZ>);
-    std::vector<pcl::PointIndices> clusters_indices;
-    this->euclidean_cluster_extraction.setSearchMethod(tree);
-    this->euclidean_cluster_extraction.setInputCloud(input);
-    this->euclidean_cluster_extraction.extract(clusters_indices);
-
-    if (clusters_indices.size() == 0)
-    {
-        return false;
-    }
-
-    float closest_dist = 100.0;
-    Eigen::Vector4f zero_point(0.0, 0.0, 0.0, 0.0);
-    for (size_t i = 0; i < clusters_indices.size(); i++)
-    {
-        const pcl::PointIndices& cluster_indices = clusters_indices[i];
-        Eigen::Vector4f centroid;
-        pcl::compute3DCentroid(*input, cluster_indices, centroid);
-        float dist = pcl::L2_Norm(centroid, zero_point, 3);
-        if (dist < closest_dist)
-        {
-            closest_dist = dist;
-            closest_centroid = centroid;
-        }
-    }
-    return true;
-}
-
 int main(int argc, char *argv[])
 {
     ros::init(argc, argv, "drawer_handle_perceiver");
     DrawerHandlePerceiver dhperceiver;
-    ros::Rate loop_rate(10.0);
-    while (ros::ok())
-    {
-        loop_rate.sleep();
-        ros::spinOnce();
-    }
+    ros::spin();
     return 0;
 }